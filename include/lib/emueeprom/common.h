@@ -27,6 +27,34 @@
 #error EMU_EEPROM_PAGE_SIZE not defined!
 #endif
 
+#ifndef EMU_EEPROM_MAX_PARTITIONS
+#define EMU_EEPROM_MAX_PARTITIONS 4
+#endif
+
+#ifndef EMU_EEPROM_MAX_KEYS
+#define EMU_EEPROM_MAX_KEYS 0
+#endif
+
+#ifndef EMU_EEPROM_MAX_BIT_RECORDS
+#define EMU_EEPROM_MAX_BIT_RECORDS 4
+#endif
+
+#ifndef EMU_EEPROM_CACHE_SIZE
+#define EMU_EEPROM_CACHE_SIZE 0
+#endif
+
+#ifndef EMU_EEPROM_INDEX_SIZE
+#define EMU_EEPROM_INDEX_SIZE 32
+#endif
+
+#ifndef EMU_EEPROM_MAX_SCHEDULED
+#define EMU_EEPROM_MAX_SCHEDULED 16
+#endif
+
+#ifndef EMU_EEPROM_MAX_MIGRATIONS
+#define EMU_EEPROM_MAX_MIGRATIONS 32
+#endif
+
 namespace lib::emueeprom
 {
     enum class pageStatus_t : uint32_t
@@ -60,6 +88,20 @@ namespace lib::emueeprom
         PAGE_FACTORY
     };
 
+    enum class compaction_t : uint8_t
+    {
+        IDLE,
+        COPYING,    ///< Variables are being copied to the new page
+        ERASING     ///< Old page is being erased
+    };
+
+    /// Flash operations done by an instance since it was created.
+    struct FlashUsage
+    {
+        uint32_t programmed = 0;    ///< Words programmed
+        uint32_t erased     = 0;    ///< Sectors erased
+    };
+
     class Hwa
     {
         public:
@@ -67,5 +109,54 @@ namespace lib::emueeprom
         virtual bool erasePage(page_t page)                                = 0;
         virtual bool write32(page_t page, uint32_t address, uint32_t data) = 0;
         virtual bool read32(page_t page, uint32_t address, uint32_t& data) = 0;
+
+        /// Optional: returns pointer to the page contents if flash is directly addressable.
+        /// When available, page scans are done directly over memory instead of through read32.
+        virtual const uint32_t* pageAddress(page_t)
+        {
+            return nullptr;
+        }
+
+        /// Optional: returns size of the page in bytes.
+        /// Pages can differ in size, but each must be at least EMU_EEPROM_PAGE_SIZE large,
+        /// since that determines the address space. Larger pages make page transfers less frequent.
+        virtual uint32_t pageSize(page_t)
+        {
+            return EMU_EEPROM_PAGE_SIZE;
+        }
+
+        /// Optional: returns number of sectors the page spans.
+        /// Each sector is erased separately with eraseSector().
+        virtual uint32_t sectorCount(page_t)
+        {
+            return 1;
+        }
+
+        /// Optional: erases single sector of the page.
+        virtual bool eraseSector(page_t page, uint32_t)
+        {
+            return erasePage(page);
+        }
+
+        /// Optional: returns flash bank holding the page.
+        /// When pages are in separate banks which can be erased and programmed independently,
+        /// old page is erased in the background while the new one is already in use after page transfer.
+        virtual uint8_t bank(page_t)
+        {
+            return 0;
+        }
+
+        /// Optional: starts erasing single sector of the page without waiting for it to finish.
+        /// The page isn't accessed again until busy() reports that the erase is done.
+        virtual bool startEraseSector(page_t page, uint32_t sector)
+        {
+            return eraseSector(page, sector);
+        }
+
+        /// Optional: returns true while erase started on the bank holding the page is still in progress.
+        virtual bool busy(page_t)
+        {
+            return false;
+        }
     };
 }    // namespace lib::emueeprom
\ No newline at end of file
@@ -22,28 +22,167 @@
 #pragma once
 
 #include "common.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <array>
+#include <algorithm>
+#include <bitset>
+#include <atomic>
 
 namespace lib::emueeprom
 {
-    class EmuEEPROM
+    /// Emulated EEPROM on top of two flash pages.
+    /// HwaImpl is the flash driver type: all flash access is resolved statically against it,
+    /// so a driver class marked final (or one not deriving from Hwa at all, but providing the
+    /// same set of functions) gets its calls inlined into page scans and transfers.
+    /// Use EmuEEPROM alias for the virtual Hwa interface.
+    template<typename HwaImpl>
+    class BasicEmuEEPROM
     {
         public:
-        EmuEEPROM(Hwa& hwa, bool useFactoryPage)
+        /// Number of words in page available for records (everything except the page header).
+        static constexpr uint32_t RECORD_WORDS = (EMU_EEPROM_PAGE_SIZE / 4) - 1;
+
+        /// Number of words taken by the transfer record which ends each page transfer.
+        static constexpr uint32_t TRANSFER_WORDS = 2;
+
+        /// Addresses below 0xFFFF take a single word on flash, higher ones take two.
+        /// Address space is sized so that all variables still fit into single page.
+        /// With all of them in use, there is no room left for the transfer record, see finishCopy().
+        static constexpr uint32_t MAX_ADDRESS = RECORD_WORDS <= 0xFFFF ? RECORD_WORDS : 0xFFFF + ((RECORD_WORDS - 0xFFFF) / 2);
+
+        /// Entire page is cached in RAM unless EMU_EEPROM_CACHE_SIZE is set: only that many recently
+        /// used variables are kept then, while the rest is looked up on flash through a small offset index.
+        static constexpr bool BOUNDED_CACHE = EMU_EEPROM_CACHE_SIZE != 0;
+
+        /// Empty when bounded cache is used.
+        using cache_t = std::array<uint16_t, BOUNDED_CACHE ? 0 : MAX_ADDRESS>;
+        using image_t = std::array<uint32_t, EMU_EEPROM_PAGE_SIZE / 4>;
+
+        /// Copy of the cache placed by the caller in memory retained across warm resets, see setRetainedState().
+        /// Valid page, its generation, end of written data and the last record word serve as a stamp of flash contents
+        /// at the time the copy was last updated.
+        struct RetainedState
+        {
+            uint32_t                                                          magic             = 0;
+            uint32_t                                                          busy              = 0;    ///< Set while the state is being updated
+            uint32_t                                                          checksum          = 0;
+            uint32_t                                                          validPage         = 0;
+            uint32_t                                                          nextOffsetToWrite = 0;
+            uint32_t                                                          lastWord          = 0;
+            uint32_t                                                          generation        = 0;
+            uint32_t                                                          transferOffset    = 0;
+            uint32_t                                                          layout            = 0;
+            cache_t                                                           cache             = {};
+            std::array<uint32_t, BOUNDED_CACHE ? 0 : (MAX_ADDRESS + 31) / 32> dirty             = {};
+        };
+
+        /// Handle to a logical partition defined with definePartitions().
+        /// Addresses are relative to the partition start and limited to the partition size.
+        /// All partitions share the same page pair and are compacted together on page transfer.
+        class Partition
+        {
+            public:
+            Partition(BasicEmuEEPROM& emuEEPROM, uint8_t index)
+                : _emuEEPROM(emuEEPROM)
+                , _index(index)
+            {}
+
+            readStatus_t  read(uint32_t address, uint16_t& data);
+            writeStatus_t write(uint32_t address, uint16_t data, bool cacheOnly = false);
+            bool          clear();
+            bool          format();
+            uint32_t      size() const;
+
+            private:
+            BasicEmuEEPROM& _emuEEPROM;
+            uint8_t         _index;
+        };
+
+        /// Entry of the table passed to defineLayout(): in given layout version, variable at address from
+        /// moved to address to, with its value optionally converted by transform.
+        struct Migration
+        {
+            using transform_t = uint16_t (*)(uint16_t value);
+
+            /// Used as the target address for variables which were dropped.
+            static constexpr uint32_t REMOVED = 0xFFFFFFFF;
+
+            uint16_t    version   = 0;
+            uint32_t    from      = 0;
+            uint32_t    to        = 0;
+            transform_t transform = nullptr;    ///< Value is moved as it is if not set
+        };
+
+        BasicEmuEEPROM(HwaImpl& hwa, bool useFactoryPage)
             : _hwa(hwa)
             , _useFactoryPage(useFactoryPage)
         {}
 
-        bool          init();
-        readStatus_t  read(uint32_t address, uint16_t& data);
-        writeStatus_t write(uint32_t address, uint16_t data, bool cacheOnly = false);
-        bool          format();
-        pageStatus_t  pageStatus(page_t page);
-        writeStatus_t pageTransfer();
-        uint32_t      maxAddress() const;
-        void          writeCacheToFlash();
+        bool           init();
+        readStatus_t   read(uint32_t address, uint16_t& data);
+        readStatus_t   read(uint32_t first, uint16_t* data, uint32_t count, uint32_t& present);
+        writeStatus_t  write(uint32_t address, uint16_t data, bool cacheOnly = false);
+        bool           format();
+        pageStatus_t   pageStatus(page_t page);
+        writeStatus_t  pageTransfer();
+        uint32_t       maxAddress() const;
+        void           writeCacheToFlash();
+
+        /// Read-only view of the entire cache, indexed by address, with 0xFFFF for variables not in use.
+        /// Not available with bounded cache, which keeps only recently used variables: use read() instead.
+        template<bool BOUNDED = BOUNDED_CACHE>
+        const cache_t& cacheView() const;
+
+        bool           definePartitions(const uint32_t* sizes, uint8_t count);
+        Partition      partition(uint8_t index);
+        bool           importImage(const uint32_t* image, uint32_t size);
+        uint32_t       exportImage(image_t& image);
+        bool           setFlushReserve(uint32_t records);
+        writeStatus_t  emergencyFlush();
+        bool           defineKeys(uint32_t slots);
+        readStatus_t   readKey(uint32_t key, uint16_t& data);
+        readStatus_t   readKey(const char* key, uint16_t& data);
+        writeStatus_t  writeKey(uint32_t key, uint16_t data, bool cacheOnly = false);
+        writeStatus_t  writeKey(const char* key, uint16_t data, bool cacheOnly = false);
+        writeStatus_t  increment(uint32_t address);
+        writeStatus_t  clearFlags(uint32_t address, uint16_t mask);
+        writeStatus_t  remove(uint32_t address);
+        writeStatus_t  removeRange(uint32_t first, uint32_t count);
+        void           setTrace(Trace* trace);
+        bool           setRetainedState(RetainedState* state);
+        uint8_t        fillLevel();
+        compaction_t   compactionState() const;
+        writeStatus_t  compact(uint32_t& words);
+        FlashUsage     flashUsage() const;
+        bool           defineLayout(uint16_t version, const Migration* migrations, uint32_t count);
+        uint16_t       layoutVersion() const;
+
+        /// Hashes string key into 32-bit one (FNV-1a).
+        /// Result never contains 0xFFFF in any of its halves, so it's always a valid key.
+        static constexpr uint32_t KEY_HASH(const char* key)
+        {
+            uint32_t hash = 2166136261UL;
+
+            while (*key)
+            {
+                hash ^= static_cast<uint8_t>(*key++);
+                hash *= 16777619UL;
+            }
+
+            if ((hash >> 16) == 0xFFFF)
+            {
+                hash ^= 0x00010000;
+            }
+
+            if ((hash & 0xFFFF) == 0xFFFF)
+            {
+                hash ^= 0x00000001;
+            }
+
+            return hash;
+        }
 
         private:
         enum class pageOp_t : uint8_t
@@ -52,15 +191,277 @@ namespace lib::emueeprom
             WRITE
         };
 
-        static constexpr uint32_t MAX_ADDRESS = (EMU_EEPROM_PAGE_SIZE / 4) - 1;
+        /// First word of a record whose address doesn't fit into upper half of a single word:
+        /// 0xFFFF (never a valid single-word address) followed by the upper address half.
+        /// Second word holds the lower address half and the value.
+        static constexpr uint32_t EXTENDED_MARKER = 0xFFFF0000;
+
+        /// Markers with upper address half of 0xFF00 and above denote special records instead.
+        static constexpr uint16_t SPECIAL_RECORD = 0xFF00;
+
+        /// Counter: marker, address and base value, followed by COUNTER_WORDS thermometer-coded words.
+        /// Each increment clears one more bit in place, value is base increased by the number of cleared bits.
+        static constexpr uint16_t COUNTER_RECORD = 0xFF01;
+        static constexpr uint32_t COUNTER_WORDS  = 2;
+
+        /// Flags: marker followed by address and value, with value bits cleared in place.
+        static constexpr uint16_t FLAGS_RECORD = 0xFF02;
+
+        /// Tombstone: marker followed by the first removed address and the number of removed addresses.
+        static constexpr uint16_t TOMBSTONE_RECORD = 0xFF03;
+        static constexpr uint32_t TOMBSTONE_SIZE   = 12;
+
+        /// Transfer: marker followed by page generation, written once all variables are copied to the new page.
+        /// New page holding it has everything even if the transfer got interrupted afterwards.
+        static constexpr uint16_t TRANSFER_RECORD = 0xFF04;
 
-        Hwa&                              _hwa;
-        bool                              _useFactoryPage;
-        std::array<uint16_t, MAX_ADDRESS> _eepromCache = {};
-        uint32_t                          _nextOffsetToWrite;
+        /// Layout: marker followed by layout version of the records after it.
+        /// Records before it are in the older layout and are migrated when parsed.
+        static constexpr uint16_t LAYOUT_RECORD = 0xFF05;
+
+        static constexpr uint32_t RETAINED_MAGIC = 0x52454D45;
+
+        /// Contribution of a single word to the retained state checksum.
+        /// Depends on word position as well, so that values which moved are detected.
+        static constexpr uint32_t CHECKSUM_WORD(uint32_t index, uint32_t value)
+        {
+            return ((value ^ index) * 0x9E3779B1UL) + index;
+        }
+
+        /// Each key-value slot uses three consecutive addresses: upper and lower half of the key and the value.
+        static constexpr uint32_t KEY_SLOT_SIZE = 3;
+
+        /// Size of the open-addressing key index: power of two, at least twice the number of keys.
+        static constexpr uint32_t KEY_INDEX_SIZE()
+        {
+            uint32_t size = 1;
+
+            while (size < (EMU_EEPROM_MAX_KEYS * 2))
+            {
+                size <<= 1;
+            }
+
+            return size;
+        }
+
+        static_assert((EMU_EEPROM_MAX_KEYS * KEY_SLOT_SIZE) < MAX_ADDRESS, "Too many keys for a single page");
+
+        struct PartitionDescriptor
+        {
+            uint32_t start = 0;
+            uint32_t size  = 0;
+        };
+
+        enum class recordType_t : uint8_t
+        {
+            VARIABLE,
+            COUNTER,
+            FLAGS,
+            TOMBSTONE,
+            TRANSFER,
+            LAYOUT
+        };
+
+        struct Record
+        {
+            uint32_t     address = 0;
+            uint16_t     value   = 0;
+            uint32_t     offset  = 0;    ///< Offset of the first record word
+            recordType_t type    = recordType_t::VARIABLE;
+            uint32_t     count   = 1;    ///< Number of removed addresses for tombstones, page generation for transfer records, version for layout records
+        };
+
+        /// Counter or flags record updated in place.
+        struct BitRecord
+        {
+            uint16_t address = 0xFFFF;
+            uint32_t offset  = 0;
+            bool     counter = false;
+        };
+
+        struct CacheEntry
+        {
+            uint16_t address = 0xFFFF;
+            uint16_t value   = 0xFFFF;
+            bool     dirty   = false;
+        };
+
+        /// Erase of the old page running in the background while the new page is being programmed.
+        struct EraseState
+        {
+            page_t   page    = page_t::PAGE_1;
+            uint32_t sector  = 0;        ///< Next sector to erase
+            bool     active  = false;
+            bool     discard = false;    ///< Page is the new page of an aborted transfer rather than the old one
+        };
+
+        /// Page transfer done in steps with compact(). Old page stays valid and keeps receiving
+        /// writes until all the variables are copied.
+        struct CompactionState
+        {
+            page_t   page    = page_t::PAGE_1;    ///< Page being copied to
+            uint32_t offset  = 0;                 ///< End of data in the page being copied to
+            uint32_t address = 0;                 ///< Next address to copy
+            bool     active  = false;
+        };
+
+        /// Marks retained state as being updated for the duration of the enclosing scope.
+        class RetainedGuard
+        {
+            public:
+            explicit RetainedGuard(BasicEmuEEPROM& emuEEPROM)
+                : _emuEEPROM(emuEEPROM)
+            {
+                _emuEEPROM.beginUpdate();
+            }
+
+            ~RetainedGuard()
+            {
+                _emuEEPROM.endUpdate();
+            }
+
+            private:
+            BasicEmuEEPROM& _emuEEPROM;
+        };
+
+        /// Records the public API call for the duration of the enclosing scope,
+        /// unless it's made from within another recorded call.
+        class TraceScope
+        {
+            public:
+            TraceScope(BasicEmuEEPROM& emuEEPROM, traceOp_t op, uint32_t address = 0, uint32_t data = 0)
+                : _emuEEPROM(emuEEPROM)
+            {
+                if (!_emuEEPROM._traceDepth++)
+                {
+                    _emuEEPROM.trace(op, address, data);
+                }
+            }
+
+            ~TraceScope()
+            {
+                _emuEEPROM._traceDepth--;
+            }
+
+            private:
+            BasicEmuEEPROM& _emuEEPROM;
+        };
+
+        static_assert(!BOUNDED_CACHE || (MAX_ADDRESS <= 0xFFFF), "Bounded cache supports only 16-bit addresses");
+        static_assert((EMU_EEPROM_INDEX_SIZE & (EMU_EEPROM_INDEX_SIZE - 1)) == 0, "Index size must be a power of two");
+
+        HwaImpl&                                                          _hwa;
+        bool                                                              _useFactoryPage;
+        cache_t                                                           _eepromCache = {};
+        uint32_t                                                          _nextOffsetToWrite;
+        std::array<PartitionDescriptor, EMU_EEPROM_MAX_PARTITIONS>        _partitions     = {};
+        uint8_t                                                           _partitionCount = 0;
+        std::array<uint32_t, BOUNDED_CACHE ? 0 : (MAX_ADDRESS + 31) / 32> _dirty          = {};
+        uint32_t                                                          _flushReserve   = 0;
+        std::array<uint16_t, KEY_INDEX_SIZE()>                            _keyIndex       = {};
+        uint32_t                                                          _keySlots       = 0;
+        uint32_t                                                          _freeKeySlot    = 0;
+        Trace*                                                            _trace          = nullptr;
+        uint8_t                                                           _traceDepth     = 0;
+        std::array<CacheEntry, EMU_EEPROM_CACHE_SIZE>                     _lru            = {};    ///< Most recently used first.
+        std::array<uint16_t, BOUNDED_CACHE ? EMU_EEPROM_INDEX_SIZE : 0>   _offsetIndex    = {};    ///< Word index of the latest record per address bucket.
+        std::array<uint32_t, BOUNDED_CACHE ? (MAX_ADDRESS + 31) / 32 : 0> _transferred    = {};
+        uint32_t                                                          _dropFirst      = 0;
+        uint32_t                                                          _dropCount      = 0;
+        std::array<uint32_t, 3>                                           _pageSize       = { EMU_EEPROM_PAGE_SIZE, EMU_EEPROM_PAGE_SIZE, EMU_EEPROM_PAGE_SIZE };
+        std::array<BitRecord, EMU_EEPROM_MAX_BIT_RECORDS>                 _bitRecords     = {};
+        bool                                                              _dualBank       = false;
+        EraseState                                                        _erase          = {};
+        CompactionState                                                   _compaction     = {};
+        uint32_t                                                          _generation     = 0;    ///< Generation of the valid page.
+        uint32_t                                                          _transferOffset = 0;    ///< Offset of the transfer record on the valid page, 0 if it has none.
+        const Migration*                                                  _migrations     = nullptr;
+        uint32_t                                                          _migrationCount = 0;
+        uint16_t                                                          _layoutVersion  = 0;    ///< Layout version used by the application.
+        uint16_t                                                          _cachedLayout   = 0;    ///< Layout version of the cached variables.
+        RetainedState*                                                    _retained       = nullptr;
+        uint32_t                                                          _retainedSum    = 0;    ///< Checksum of retained cache and dirty flags.
+        uint8_t                                                           _updateDepth    = 0;
+        bool                                                              _resync         = false;
+        bool                                                              _restamp        = false;
+        FlashUsage                                                        _usage          = {};
 
         bool          findValidPage(pageOp_t operation, page_t& page);
-        writeStatus_t writeInternal(uint16_t address, uint16_t data, bool cacheOnly = false);
+        readStatus_t  readInternal(uint32_t address, uint16_t& data);
+        writeStatus_t writeInternal(uint32_t address, uint16_t data, bool cacheOnly = false, bool useReserve = false);
+        writeStatus_t writeWithTransfer(uint32_t address, uint16_t data, bool cacheOnly);
+        writeStatus_t allocate(uint32_t size, bool useReserve, page_t& page, uint32_t& offset);
+        bool          writeRecord(page_t page, uint32_t& offset, uint32_t address, uint16_t data);
+        bool          program(page_t page, uint32_t offset, uint32_t data);
+        writeStatus_t copyVariables(uint32_t& words);
+        writeStatus_t completeCopy();
+        writeStatus_t finishCopy(page_t oldPage);
+        bool          copyRecord(uint32_t address, uint16_t data);
+        void          abortCompaction();
+        uint32_t      transferSize() const;
+        bool          reserveFits(uint32_t used) const;
+        writeStatus_t writeBitRecord(uint32_t address, uint16_t value, bool counter);
+        bool          updateBitRecord(BitRecord& record, uint16_t value);
+        BitRecord*    findBitRecord(uint32_t address);
+        BitRecord*    addBitRecord(uint32_t address);
         bool          cache();
+        void          resetCache();
+        void          setDirty(uint32_t address, bool state);
+        void          setCache(uint32_t address, uint16_t value);
+        void          beginUpdate();
+        void          endUpdate();
+        bool          restoreRetained();
+        uint32_t      retainedContentSum() const;
+        uint32_t      retainedChecksum(uint32_t contentSum) const;
+        bool          clearRange(uint32_t first, uint32_t count, bool restoreFactory);
+        void          rebuildKeyIndex();
+        void          insertKey(uint32_t key, uint32_t slot);
+        bool          findKey(uint32_t key, uint32_t& slot);
+        uint32_t      keySlotAddress(uint32_t slot) const;
+        void          trace(traceOp_t op, uint32_t address, uint32_t data);
+        bool          readGeometry();
+        uint32_t      pageSize(page_t page) const;
+        bool          erase(page_t page);
+        void          startErase(page_t page, bool discard = false);
+        bool          serviceErase();
+        bool          completeErase();
+        bool          finishErase();
+        bool          completeTransfer(page_t oldPage);
+        bool          recoverTransfer(page_t newPage);
+        bool          writeTransferRecord();
+        bool          pageGeneration(page_t page, uint32_t& generation);
+        bool          updateLayout(bool migrate);
+        bool          writeLayoutRecord(page_t page, uint32_t& offset);
+        void          migrateCache(uint16_t from, uint16_t to);
+        bool          remapped(uint32_t address, uint16_t from, uint16_t to) const;
+        uint16_t      cacheValue(uint32_t address);
+        CacheEntry*   findEntry(uint32_t address);
+        CacheEntry*   touchEntry(uint32_t address, bool allocate);
+        bool          findOnFlash(page_t page, uint32_t address, uint16_t& data);
+        uint32_t      copyLatest(page_t oldPage, uint32_t end, bool write);
+        void          removeCached(uint32_t first, uint32_t count, uint32_t offset);
+
+        template<typename Reader>
+        bool formatWithImage(Reader&& readWord, uint32_t size);
+
+        template<typename Handler>
+        uint32_t parsePage(page_t page, Handler&& handler, uint32_t start = sizeof(pageStatus_t));
+
+        template<typename Handler, typename Reader>
+        uint32_t parseRecords(page_t page, Handler&& handler, Reader&& readWord, uint32_t start);
+
+        uint32_t        findEndOfData(page_t page);
+        static uint32_t firstMarkedWord(const uint32_t* words, uint32_t index, uint32_t end);
+        static uint32_t recordSize(uint32_t data);
+
+        template<typename Handler>
+        void parsePageBackward(page_t page, uint32_t start, Handler&& handler);
+
+        static uint32_t keyIndexStart(uint32_t key);
     };
+
+    using EmuEEPROM = BasicEmuEEPROM<Hwa>;
 }    // namespace lib::emueeprom
+
+// member definitions are kept apart from the declarations, but stay visible for instantiations with other flash drivers
+#include "emueeprom.tpp"
\ No newline at end of file
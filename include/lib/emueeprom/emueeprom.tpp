@@ -0,0 +1,3239 @@
+/*
+    Copyright 2017-2022 Igor Petrovic
+
+    Permission is hereby granted, free of charge, to any person obtaining
+    a copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+    OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+namespace lib::emueeprom
+{
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::init()
+    {
+        TraceScope scope(*this, traceOp_t::INIT);
+
+        if (!_hwa.init())
+        {
+            return false;
+        }
+
+        if (!readGeometry())
+        {
+            return false;
+        }
+
+        // copied variables of unfinished page transfer are discarded along with the new page below
+        _compaction = CompactionState();
+
+        // erase possibly left running by the previous init()
+        finishErase();
+
+        // RAM state which survived warm reset makes page scan unnecessary, as long as it matches flash
+        if (restoreRetained())
+        {
+            return true;
+        }
+
+        RetainedGuard guard(*this);
+        bool          doCache = true;
+
+        _nextOffsetToWrite = 0;
+        resetCache();
+
+        auto page1Status = pageStatus(page_t::PAGE_1);
+        auto page2Status = pageStatus(page_t::PAGE_2);
+
+        // interrupted page transfer is either completed or discarded, without touching the data
+        if ((page1Status == pageStatus_t::RECEIVING) || (page2Status == pageStatus_t::RECEIVING))
+        {
+            if (!recoverTransfer(page1Status == pageStatus_t::RECEIVING ? page_t::PAGE_1 : page_t::PAGE_2))
+            {
+                // nothing left to recover from
+                return format();
+            }
+
+            page1Status = pageStatus(page_t::PAGE_1);
+            page2Status = pageStatus(page_t::PAGE_2);
+        }
+
+        // check for invalid header states and repair if necessary
+        switch (page1Status)
+        {
+        case pageStatus_t::ERASED:
+        {
+            if (page2Status == pageStatus_t::VALID)
+            {
+                // page 1 erased, page 2 valid
+                // format page 1 properly
+                erase(page_t::PAGE_1);
+
+                if (!program(page_t::PAGE_1, 0, static_cast<uint32_t>(pageStatus_t::FORMATTED)))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                // invalid state
+                if (!format())
+                {
+                    return false;
+                }
+
+                // caching is done automatically after formatting if possible
+                doCache = false;
+            }
+        }
+        break;
+
+        case pageStatus_t::VALID:
+        {
+            if (page2Status == pageStatus_t::VALID)
+            {
+                // both pages valid: the one written by the later transfer is kept
+                uint32_t page1Generation;
+                uint32_t page2Generation;
+
+                const bool PAGE_1_TRANSFERRED = pageGeneration(page_t::PAGE_1, page1Generation);
+                const bool PAGE_2_TRANSFERRED = pageGeneration(page_t::PAGE_2, page2Generation);
+
+                if (PAGE_1_TRANSFERRED && PAGE_2_TRANSFERRED && (page1Generation != page2Generation))
+                {
+                    const page_t OLDER = static_cast<int32_t>(page1Generation - page2Generation) > 0 ? page_t::PAGE_2 : page_t::PAGE_1;
+
+                    erase(OLDER);
+
+                    if (!program(OLDER, 0, static_cast<uint32_t>(pageStatus_t::FORMATTED)))
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    // no way to tell which one is newer
+                    if (!format())
+                    {
+                        return false;
+                    }
+
+                    doCache = false;
+                }
+            }
+            else if (page2Status == pageStatus_t::ERASED)
+            {
+                // page 1 valid, page 2 erased
+                // format page2
+                erase(page_t::PAGE_2);
+
+                if (!program(page_t::PAGE_2, 0, static_cast<uint32_t>(pageStatus_t::FORMATTED)))
+                {
+                    return false;
+                }
+            }
+            else if (page2Status == pageStatus_t::FORMATTED)
+            {
+                // nothing to do
+            }
+            else
+            {
+                // invalid state
+                if (!format())
+                {
+                    return false;
+                }
+
+                // caching is done automatically after formatting if possible
+                doCache = false;
+            }
+        }
+        break;
+
+        case pageStatus_t::FORMATTED:
+        {
+            if (page2Status == pageStatus_t::VALID)
+            {
+                // nothing to do
+            }
+            else
+            {
+                // invalid state
+                if (!format())
+                {
+                    return false;
+                }
+
+                // caching is done automatically after formatting if possible
+                doCache = false;
+            }
+        }
+        break;
+
+        default:
+        {
+            // invalid state
+            if (!format())
+            {
+                return false;
+            }
+
+            // caching is done automatically after formatting if possible
+            doCache = false;
+        }
+        break;
+        }
+
+        if (doCache)
+        {
+            // if caching fails for any reason, just format everything
+            if (!cache())
+            {
+                format();
+            }
+            else if (!updateLayout(true))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::format()
+    {
+        TraceScope scope(*this, traceOp_t::FORMAT);
+
+        // copy contents from factory page to page 1 if the page is in correct status
+        if (_useFactoryPage && (pageStatus(page_t::PAGE_FACTORY) == pageStatus_t::VALID))
+        {
+            const uint32_t* factory = _hwa.pageAddress(page_t::PAGE_FACTORY);
+
+            auto readFactory = [this, factory](uint32_t offset, uint32_t& data)
+            {
+                if (factory != nullptr)
+                {
+                    data = factory[offset / 4];
+                    return true;
+                }
+
+                return _hwa.read32(page_t::PAGE_FACTORY, offset, data);
+            };
+
+            return formatWithImage(readFactory, std::min(pageSize(page_t::PAGE_FACTORY), pageSize(page_t::PAGE_1)));
+        }
+
+        // no image to copy - page 1 will only get the valid status
+        auto readNone = [](uint32_t, uint32_t&)
+        {
+            return false;
+        };
+
+        return formatWithImage(readNone, 0);
+    }
+
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::importImage(const uint32_t* image, uint32_t size)
+    {
+        TraceScope scope(*this, traceOp_t::IMPORT_IMAGE, size);
+
+        if ((size < sizeof(pageStatus_t)) || (size > pageSize(page_t::PAGE_1)) || (size % 4))
+        {
+            return false;
+        }
+
+        if (image[0] != static_cast<uint32_t>(pageStatus_t::VALID))
+        {
+            return false;
+        }
+
+        auto readImage = [image](uint32_t offset, uint32_t& data)
+        {
+            data = image[offset / 4];
+            return true;
+        };
+
+        return formatWithImage(readImage, size);
+    }
+
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::exportImage(image_t& image)
+    {
+        TraceScope scope(*this, traceOp_t::EXPORT_IMAGE);
+        uint32_t   words = 0;
+
+        std::fill(image.begin(), image.end(), 0xFFFFFFFF);
+        image[words++] = static_cast<uint32_t>(pageStatus_t::VALID);
+
+        // address space is sized so that the entire cache fits into page
+        for (uint32_t i = 0; i < MAX_ADDRESS; i++)
+        {
+            const uint16_t VALUE = cacheValue(i);
+
+            if (VALUE == 0xFFFF)
+            {
+                continue;
+            }
+
+            if (i >= 0xFFFF)
+            {
+                image[words++] = EXTENDED_MARKER | i >> 16;
+                image[words++] = (i & 0xFFFF) << 16 | VALUE;
+            }
+            else
+            {
+                image[words++] = i << 16 | VALUE;
+            }
+        }
+
+        return words * 4;
+    }
+
+    template<typename HwaImpl>
+    template<typename Reader>
+    bool BasicEmuEEPROM<HwaImpl>::formatWithImage(Reader&& readWord, uint32_t size)
+    {
+        RetainedGuard guard(*this);
+
+        // background erase would otherwise complete the previous transfer on top of the image
+        finishErase();
+        _compaction = CompactionState();
+
+        // erase both pages, copy the image to page 1 and set it as valid
+
+        if (!erase(page_t::PAGE_1))
+        {
+            return false;
+        }
+
+        if (!erase(page_t::PAGE_2))
+        {
+            return false;
+        }
+
+        // clear out cache
+        resetCache();
+        _nextOffsetToWrite = 0;
+
+        // image header is skipped here: valid status is written only once all the data is in place
+        // entire image is copied record by record: blank words within multi-word records are kept,
+        // while those between the records are left out so that the page has no gaps
+        for (uint32_t i = sizeof(pageStatus_t), offset = sizeof(pageStatus_t); i < size;)
+        {
+            uint32_t data;
+
+            if (!readWord(i, data))
+            {
+                return false;
+            }
+
+            if (data == 0xFFFFFFFF)
+            {
+                i += 4;
+                continue;
+            }
+
+            const uint32_t RECORD_SIZE = std::min(recordSize(data), size - i);
+
+            for (uint32_t word = 0; word < RECORD_SIZE; word += 4)
+            {
+                if (word && !readWord(i + word, data))
+                {
+                    return false;
+                }
+
+                // blank words are already in place after erase
+                if ((data != 0xFFFFFFFF) && !program(page_t::PAGE_1, offset + word, data))
+                {
+                    return false;
+                }
+            }
+
+            i += RECORD_SIZE;
+            offset += RECORD_SIZE;
+        }
+
+        if (!program(page_t::PAGE_1, 0, static_cast<uint32_t>(pageStatus_t::VALID)))
+        {
+            return false;
+        }
+
+        if (!program(page_t::PAGE_2, 0, static_cast<uint32_t>(pageStatus_t::FORMATTED)))
+        {
+            return false;
+        }
+
+        // nothing to cache if there was no data in image
+        if ((size > sizeof(pageStatus_t)) && !cache())
+        {
+            return false;
+        }
+
+        // image without layout record is taken as being in the current layout
+        return updateLayout(_cachedLayout != 0);
+    }
+
+    template<typename HwaImpl>
+    readStatus_t BasicEmuEEPROM<HwaImpl>::read(uint32_t address, uint16_t& data)
+    {
+        TraceScope scope(*this, traceOp_t::READ, address);
+
+        if (address >= maxAddress())
+        {
+            return readStatus_t::READ_ERROR;
+        }
+
+        return readInternal(address, data);
+    }
+
+    template<typename HwaImpl>
+    readStatus_t BasicEmuEEPROM<HwaImpl>::readInternal(uint32_t address, uint16_t& data)
+    {
+        if constexpr (BOUNDED_CACHE)
+        {
+            if (auto entry = touchEntry(address, false); entry != nullptr)
+            {
+                data = entry->value;
+                return readStatus_t::OK;
+            }
+
+            page_t validPage;
+
+            if (!findValidPage(pageOp_t::WRITE, validPage))
+            {
+                return readStatus_t::NO_PAGE;
+            }
+
+            if (!findOnFlash(validPage, address, data))
+            {
+                return readStatus_t::NO_VAR;
+            }
+
+            if (auto entry = touchEntry(address, true); entry != nullptr)
+            {
+                entry->value = data;
+            }
+
+            return readStatus_t::OK;
+        }
+
+        if (_eepromCache[address] != 0xFFFF)
+        {
+            data = _eepromCache[address];
+            return readStatus_t::OK;
+        }
+
+        page_t validPage;
+
+        if (!findValidPage(pageOp_t::READ, validPage))
+        {
+            return readStatus_t::NO_PAGE;
+        }
+
+        readStatus_t status = readStatus_t::NO_VAR;
+        uint16_t     layout = 0;
+
+        // page is parsed from the start, so the last matching record found is the latest one
+        auto findRecord = [this, address, &data, &status, &layout](const Record& record)
+        {
+            if (record.type == recordType_t::TOMBSTONE)
+            {
+                if ((address >= record.address) && ((address - record.address) < record.count))
+                {
+                    status = readStatus_t::NO_VAR;
+                }
+            }
+            else if (record.type == recordType_t::LAYOUT)
+            {
+                // records in older layout belong to some other variable now
+                if (remapped(address, layout, record.count))
+                {
+                    status = readStatus_t::NO_VAR;
+                }
+
+                layout = record.count;
+            }
+            else if (record.address == address)
+            {
+                data   = record.value;
+                status = readStatus_t::OK;
+            }
+
+            return true;
+        };
+
+        parsePage(validPage, findRecord);
+
+        if (status == readStatus_t::OK)
+        {
+            // cache is part of the retained state
+            RetainedGuard guard(*this);
+            setCache(address, data);
+        }
+
+        return status;
+    }
+
+    template<typename HwaImpl>
+    readStatus_t BasicEmuEEPROM<HwaImpl>::read(uint32_t first, uint16_t* data, uint32_t count, uint32_t& present)
+    {
+        TraceScope scope(*this, traceOp_t::READ_RANGE, first, count);
+
+        present = 0;
+
+        if ((first >= maxAddress()) || (count > (maxAddress() - first)))
+        {
+            return readStatus_t::READ_ERROR;
+        }
+
+        if constexpr (BOUNDED_CACHE)
+        {
+            for (uint32_t i = 0; i < count; i++)
+            {
+                data[i] = cacheValue(first + i);
+            }
+        }
+        else
+        {
+            // served straight from cache: since cache() loads entire page on init,
+            // any entry still set to 0xFFFF is treated as missing variable
+            std::copy(_eepromCache.begin() + first, _eepromCache.begin() + first + count, data);
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            present += (data[i] != 0xFFFF);
+        }
+
+        return present == count ? readStatus_t::OK : readStatus_t::NO_VAR;
+    }
+
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::write(uint32_t address, uint16_t data, bool cacheOnly)
+    {
+        TraceScope scope(*this, cacheOnly ? traceOp_t::WRITE_CACHE_ONLY : traceOp_t::WRITE, address, data);
+
+        if (address >= maxAddress())
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        return writeWithTransfer(address, data, cacheOnly);
+    }
+
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::writeWithTransfer(uint32_t address, uint16_t data, bool cacheOnly)
+    {
+        writeStatus_t status;
+
+        // rite the variable virtual address and value in the EEPROM
+        status = writeInternal(address, data, cacheOnly);
+
+        if (status == writeStatus_t::PAGE_FULL)
+        {
+            status = pageTransfer();
+
+            // write the variable again to a new page
+            if (status == writeStatus_t::OK)
+            {
+                status = writeInternal(address, data);
+            }
+        }
+
+        return status;
+    }
+
+    /// Finds space for a record of given size at the end of written data in active page.
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::allocate(uint32_t size, bool useReserve, page_t& page, uint32_t& offset)
+    {
+        // previous page transfer is completed once the old page is erased
+        // (only in the background: erasing in place is left to page transfer and compact(),
+        // and emergency flush doesn't start erasing at all)
+        if (_dualBank && !useReserve && !serviceErase())
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        if (!findValidPage(pageOp_t::WRITE, page))
+        {
+            return writeStatus_t::NO_PAGE;
+        }
+
+        // reserved space at the end of the page is available only to emergency flush and page transfer
+        const uint32_t PAGE_END_OFFSET = useReserve ? pageSize(page) : pageSize(page) - (_flushReserve * 4);
+
+        if (!_nextOffsetToWrite)
+        {
+            _nextOffsetToWrite = findEndOfData(page);
+        }
+
+        offset = _nextOffsetToWrite;
+
+        if ((offset + size) > PAGE_END_OFFSET)
+        {
+            return writeStatus_t::PAGE_FULL;
+        }
+
+        return writeStatus_t::OK;
+    }
+
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::findValidPage(pageOp_t operation, page_t& page)
+    {
+        // page being erased in the background can't be accessed until erase is done,
+        // and the other one is receiving the data
+        if (_erase.active)
+        {
+            page = _erase.page == page_t::PAGE_1 ? page_t::PAGE_2 : page_t::PAGE_1;
+            return true;
+        }
+
+        // while variables are being copied, old page still holds everything
+        if (_compaction.active)
+        {
+            page = _compaction.page == page_t::PAGE_1 ? page_t::PAGE_2 : page_t::PAGE_1;
+            return true;
+        }
+
+        auto page1Status = pageStatus(page_t::PAGE_1);
+        auto page2Status = pageStatus(page_t::PAGE_2);
+
+        switch (operation)
+        {
+        case pageOp_t::WRITE:
+        {
+            if (page2Status == pageStatus_t::VALID)
+            {
+                if (page1Status == pageStatus_t::RECEIVING)
+                {
+                    page = page_t::PAGE_1;
+                }
+                else
+                {
+                    page = page_t::PAGE_2;
+                }
+            }
+            else if (page1Status == pageStatus_t::VALID)
+            {
+                if (page2Status == pageStatus_t::RECEIVING)
+                {
+                    page = page_t::PAGE_2;
+                }
+                else
+                {
+                    page = page_t::PAGE_1;
+                }
+            }
+            else
+            {
+                // no valid page found
+                return false;
+            }
+        }
+        break;
+
+        case pageOp_t::READ:
+        {
+            if (page1Status == pageStatus_t::VALID)
+            {
+                page = page_t::PAGE_1;
+            }
+            else if (page2Status == pageStatus_t::VALID)
+            {
+                page = page_t::PAGE_2;
+            }
+            else
+            {
+                // no valid page found
+                return false;
+            }
+        }
+        break;
+
+        default:
+        {
+            page = page_t::PAGE_1;
+        }
+        break;
+        }
+
+        return true;
+    }
+
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::writeInternal(uint32_t address, uint16_t data, bool cacheOnly, bool useReserve)
+    {
+        RetainedGuard guard(*this);
+
+        // second word of such record would be indistinguishable from a blank one
+        if (((address & 0xFFFF) == 0xFFFF) && (data == 0xFFFF))
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        // counter or flags record of this variable, if any, is no longer the latest one
+        if (auto record = findBitRecord(address); record != nullptr)
+        {
+            *record = BitRecord();
+        }
+
+        if (cacheOnly)
+        {
+            if constexpr (BOUNDED_CACHE)
+            {
+                // with no clean entry left to take over, variable is written straight to flash
+                if (auto entry = touchEntry(address, true); entry != nullptr)
+                {
+                    entry->value = data;
+                    entry->dirty = true;
+                    return writeStatus_t::OK;
+                }
+            }
+            else
+            {
+                setCache(address, data);
+                setDirty(address, true);
+                return writeStatus_t::OK;
+            }
+        }
+
+        const uint32_t RECORD_SIZE = address >= 0xFFFF ? 8 : 4;
+        page_t         validPage;
+        uint32_t       writeOffset;
+
+        if (auto status = allocate(RECORD_SIZE, useReserve, validPage, writeOffset); status != writeStatus_t::OK)
+        {
+            return status;
+        }
+
+        if (!writeRecord(validPage, _nextOffsetToWrite, address, data))
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        if constexpr (BOUNDED_CACHE)
+        {
+            _offsetIndex[address & (EMU_EEPROM_INDEX_SIZE - 1)] = writeOffset / 4;
+
+            // writes only refresh existing entries, new ones are taken on read
+            if (auto entry = findEntry(address); entry != nullptr)
+            {
+                entry->value = data;
+                entry->dirty = false;
+            }
+        }
+        else
+        {
+            setCache(address, data);
+            setDirty(address, false);
+
+            // variable already copied to the new page has to be updated there as well
+            // emergency flush leaves that to the rest of the copying instead: new page which no longer
+            // fits would have to be erased to restart the transfer
+            if (_compaction.active && (address < _compaction.address))
+            {
+                if (useReserve)
+                {
+                    setDirty(address, true);
+                }
+                else
+                {
+                    copyRecord(address, data);
+                }
+            }
+        }
+
+        return writeStatus_t::OK;
+    }
+
+    /// Programs variable record at given offset. Offset is moved past the record once any part of it is written.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::writeRecord(page_t page, uint32_t& offset, uint32_t address, uint16_t data)
+    {
+        if (address < 0xFFFF)
+        {
+            if (!program(page, offset, address << 16 | data))
+            {
+                return false;
+            }
+
+            offset += 4;
+            return true;
+        }
+
+        if (!program(page, offset, EXTENDED_MARKER | address >> 16))
+        {
+            return false;
+        }
+
+        // once the marker is in place, its second word is used up even if writing it fails
+        offset += 8;
+
+        return program(page, offset - 4, (address & 0xFFFF) << 16 | data);
+    }
+
+    /// Programs single word, keeping track of flash usage.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::program(page_t page, uint32_t offset, uint32_t data)
+    {
+        _usage.programmed++;
+        return _hwa.write32(page, offset, data);
+    }
+
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::pageTransfer()
+    {
+        TraceScope    scope(*this, traceOp_t::PAGE_TRANSFER);
+        RetainedGuard guard(*this);
+
+        _restamp = true;
+
+        if (!finishErase())
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        // everything at once, continuing the transfer started with compact() if there is one
+        uint32_t   words  = UINT32_MAX;
+        const auto STATUS = copyVariables(words);
+
+        // transfer is done even if the flush reserve no longer fits
+        if ((STATUS != writeStatus_t::OK) && (STATUS != writeStatus_t::PAGE_FULL))
+        {
+            return STATUS;
+        }
+
+        // with pages in separate banks, new page is used while the old one is erased in the background
+        if (!(_dualBank ? serviceErase() : finishErase()))
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        return STATUS;
+    }
+
+    /// Copies variables to the new page, starting the page transfer if needed.
+    /// At most given amount of words is programmed, and words is decreased by the amount actually programmed.
+    /// With bounded cache, variables are looked up on flash and all of them are copied at once,
+    /// so the transfer isn't started until the given words cover that.
+    /// Once everything is copied, old page is scheduled for erase.
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::copyVariables(uint32_t& words)
+    {
+        page_t oldPage;
+
+        if (!findValidPage(pageOp_t::READ, oldPage))
+        {
+            return writeStatus_t::NO_PAGE;
+        }
+
+        if (!_compaction.active)
+        {
+            // page header is followed by the layout record, if there is one
+            if (words < (_cachedLayout ? 3 : 1))
+            {
+                return writeStatus_t::OK;
+            }
+
+            const page_t NEW_PAGE = oldPage == page_t::PAGE_1 ? page_t::PAGE_2 : page_t::PAGE_1;
+
+            // end of data in old page, if known
+            const uint32_t OLD_PAGE_END = _nextOffsetToWrite ? _nextOffsetToWrite : pageSize(oldPage);
+
+            // variables are copied all at once with bounded cache, so the transfer isn't started
+            // until they can be: they're counted on the old page first
+            if constexpr (BOUNDED_CACHE)
+            {
+                if ((words != UINT32_MAX) && (words < (1 + copyLatest(oldPage, OLD_PAGE_END, false) + TRANSFER_WORDS)))
+                {
+                    return writeStatus_t::OK;
+                }
+            }
+
+            if (!program(NEW_PAGE, 0, static_cast<uint32_t>(pageStatus_t::RECEIVING)))
+            {
+                return writeStatus_t::WRITE_ERROR;
+            }
+
+            words--;
+            _restamp = true;
+
+            // counters and flags are folded into plain records
+            _bitRecords.fill(BitRecord());
+
+            if constexpr (BOUNDED_CACHE)
+            {
+                _nextOffsetToWrite = sizeof(pageStatus_t);
+                words -= std::min(words, copyLatest(oldPage, OLD_PAGE_END, true) + TRANSFER_WORDS);
+
+                return finishCopy(oldPage);
+            }
+
+            _compaction.page    = NEW_PAGE;
+            _compaction.offset  = sizeof(pageStatus_t);
+            _compaction.address = 0;
+            _compaction.active  = true;
+
+            // variables are copied in their current layout
+            if (_cachedLayout)
+            {
+                if (!writeLayoutRecord(NEW_PAGE, _compaction.offset))
+                {
+                    abortCompaction();
+                    return writeStatus_t::WRITE_ERROR;
+                }
+
+                words -= 2;
+            }
+        }
+
+        if constexpr (!BOUNDED_CACHE)
+        {
+            // normally this procedure should move all variables from one page to another,
+            // starting from the last address
+            // since we're using cache, just dump the entire cache to the new page
+            for (; _compaction.address < MAX_ADDRESS; _compaction.address++)
+            {
+                const uint32_t ADDRESS = _compaction.address;
+                const uint32_t SIZE    = ADDRESS >= 0xFFFF ? 2 : 1;
+
+                if (_eepromCache[ADDRESS] == 0xFFFF)
+                {
+                    continue;
+                }
+
+                if (words < SIZE)
+                {
+                    return writeStatus_t::OK;
+                }
+
+                if (!copyRecord(ADDRESS, _eepromCache[ADDRESS]))
+                {
+                    return writeStatus_t::WRITE_ERROR;
+                }
+
+                setDirty(ADDRESS, false);
+                words -= SIZE;
+            }
+
+            // variables written since they were copied without updating the new page
+            // (cache-only writes and emergency flush)
+            for (uint32_t i = 0; i < _dirty.size(); i++)
+            {
+                for (uint32_t bit = 0; _dirty[i] && (bit < 32); bit++)
+                {
+                    const uint32_t ADDRESS = (i * 32) + bit;
+                    const uint32_t SIZE    = ADDRESS >= 0xFFFF ? 2 : 1;
+
+                    if (!(_dirty[i] & (1UL << bit)))
+                    {
+                        continue;
+                    }
+
+                    if (words < SIZE)
+                    {
+                        return writeStatus_t::OK;
+                    }
+
+                    if (!copyRecord(ADDRESS, _eepromCache[ADDRESS]))
+                    {
+                        return writeStatus_t::WRITE_ERROR;
+                    }
+
+                    setDirty(ADDRESS, false);
+                    words -= SIZE;
+                }
+            }
+        }
+
+        // room for the transfer record
+        if (words < TRANSFER_WORDS)
+        {
+            return writeStatus_t::OK;
+        }
+
+        words -= TRANSFER_WORDS;
+        _compaction.active = false;
+        _nextOffsetToWrite = _compaction.offset;
+
+        return finishCopy(oldPage);
+    }
+
+    /// Copies the rest of the variables at once.
+    /// Needed before operations which can't be repeated on the new page as they are done on the old one.
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::completeCopy()
+    {
+        uint32_t words = UINT32_MAX;
+
+        return _compaction.active ? copyVariables(words) : writeStatus_t::OK;
+    }
+
+    /// Marks the new page as holding everything and schedules erase of the old one.
+    /// Returns PAGE_FULL if the copied variables leave less space than reserved for emergency flush.
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::finishCopy(page_t oldPage)
+    {
+        // from here on, new page holds everything and survives power loss even while old page is being erased
+        // transfer record is left out if it would take the space needed for the next write: new page is then
+        // recognized as complete by the old page no longer being valid, see recoverTransfer()
+        if (!reserveFits(_nextOffsetToWrite + (TRANSFER_WORDS * 4)) || !writeTransferRecord())
+        {
+            _transferOffset = 0;
+        }
+
+        startErase(oldPage);
+
+        return reserveFits(_nextOffsetToWrite) ? writeStatus_t::OK : writeStatus_t::PAGE_FULL;
+    }
+
+    /// Appends the variable to the page being copied to.
+    /// If the variable doesn't fit, page transfer is restarted.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::copyRecord(uint32_t address, uint16_t data)
+    {
+        const uint32_t SIZE = address >= 0xFFFF ? 8 : 4;
+
+        if (((_compaction.offset + SIZE) > pageSize(_compaction.page)) || !writeRecord(_compaction.page, _compaction.offset, address, data))
+        {
+            abortCompaction();
+            return false;
+        }
+
+        return true;
+    }
+
+    /// Discards the page being copied to. Old page is still valid and holds everything
+    /// except the cache-only variables copied so far, which are marked as not written yet.
+    /// Page is erased later on, the same way the old one is once the transfer is done.
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::abortCompaction()
+    {
+        _compaction.active = false;
+
+        for (uint32_t i = 0; i < _compaction.address; i++)
+        {
+            if (_eepromCache[i] != 0xFFFF)
+            {
+                setDirty(i, true);
+            }
+        }
+
+        startErase(_compaction.page, true);
+    }
+
+    template<typename HwaImpl>
+    pageStatus_t BasicEmuEEPROM<HwaImpl>::pageStatus(page_t page)
+    {
+        uint32_t     data;
+        pageStatus_t status;
+
+        switch (page)
+        {
+        case page_t::PAGE_1:
+        {
+            _hwa.read32(page_t::PAGE_1, 0, data);
+        }
+        break;
+
+        case page_t::PAGE_2:
+        {
+            _hwa.read32(page_t::PAGE_2, 0, data);
+        }
+        break;
+
+        case page_t::PAGE_FACTORY:
+        {
+            _hwa.read32(page_t::PAGE_FACTORY, 0, data);
+        }
+        break;
+
+        default:
+            return pageStatus_t::ERASED;
+        }
+
+        switch (data)
+        {
+        case static_cast<uint32_t>(pageStatus_t::ERASED):
+        {
+            status = pageStatus_t::ERASED;
+        }
+        break;
+
+        case static_cast<uint32_t>(pageStatus_t::RECEIVING):
+        {
+            status = pageStatus_t::RECEIVING;
+        }
+        break;
+
+        case static_cast<uint32_t>(pageStatus_t::VALID):
+        {
+            status = pageStatus_t::VALID;
+        }
+        break;
+
+        default:
+        {
+            status = pageStatus_t::FORMATTED;
+        }
+        break;
+        }
+
+        return status;
+    }
+
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::cache()
+    {
+        page_t validPage;
+        resetCache();
+
+        if (!findValidPage(pageOp_t::WRITE, validPage))
+        {
+            return false;
+        }
+
+        // page is parsed from the start, so later records override earlier ones
+        auto cacheRecord = [this](const Record& record)
+        {
+            if (record.type == recordType_t::TOMBSTONE)
+            {
+                removeCached(record.address, record.count, record.offset);
+                return true;
+            }
+
+            if (record.type == recordType_t::TRANSFER)
+            {
+                _generation     = record.count;
+                _transferOffset = record.offset;
+                return true;
+            }
+
+            // everything cached so far is in the older layout
+            if (record.type == recordType_t::LAYOUT)
+            {
+                migrateCache(_cachedLayout, record.count);
+                _cachedLayout = record.count;
+                return true;
+            }
+
+            // written with larger address space or damaged: not worth losing everything else over it
+            if (record.address >= MAX_ADDRESS)
+            {
+                return true;
+            }
+
+            if constexpr (BOUNDED_CACHE)
+            {
+                _offsetIndex[record.address & (EMU_EEPROM_INDEX_SIZE - 1)] = record.offset / 4;
+            }
+            else
+            {
+                _eepromCache[record.address] = record.value;
+            }
+
+            if constexpr (!BOUNDED_CACHE)
+            {
+                // only the latest record of a variable can be updated in place
+                if (record.type == recordType_t::VARIABLE)
+                {
+                    if (auto bitRecord = findBitRecord(record.address); bitRecord != nullptr)
+                    {
+                        *bitRecord = BitRecord();
+                    }
+                }
+                else if (auto bitRecord = addBitRecord(record.address); bitRecord != nullptr)
+                {
+                    bitRecord->offset  = record.offset;
+                    bitRecord->counter = record.type == recordType_t::COUNTER;
+                }
+            }
+
+            return true;
+        };
+
+        _nextOffsetToWrite = parsePage(validPage, cacheRecord);
+
+        rebuildKeyIndex();
+
+        return true;
+    }
+
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::maxAddress() const
+    {
+        // key-value slots take the top of the address space
+        return MAX_ADDRESS - (_keySlots * KEY_SLOT_SIZE);
+    }
+
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::writeCacheToFlash()
+    {
+        TraceScope scope(*this, traceOp_t::WRITE_CACHE_TO_FLASH);
+
+        // page transfer will make sure the cache is written out
+        pageTransfer();
+    }
+
+    template<typename HwaImpl>
+    template<bool BOUNDED>
+    const typename BasicEmuEEPROM<HwaImpl>::cache_t& BasicEmuEEPROM<HwaImpl>::cacheView() const
+    {
+        static_assert(!BOUNDED, "Entire cache isn't kept with bounded cache");
+        return _eepromCache;
+    }
+
+    /// Parses records in page from given offset (by default its start) up to the first blank word and calls
+    /// handler(record) for each of them, in order in which they were written.
+    /// Parsing stops early if handler returns false.
+    /// Returns offset following the last parsed record.
+    template<typename HwaImpl>
+    template<typename Handler>
+    uint32_t BasicEmuEEPROM<HwaImpl>::parsePage(page_t page, Handler&& handler, uint32_t start)
+    {
+        // memory-mapped page is checked once, not for each word
+        if (const uint32_t* words = _hwa.pageAddress(page); words != nullptr)
+        {
+            auto readMapped = [words](uint32_t offset, uint32_t& data)
+            {
+                data = words[offset / 4];
+                return true;
+            };
+
+            return parseRecords(page, handler, readMapped, start);
+        }
+
+        auto readFlash = [this, page](uint32_t offset, uint32_t& data)
+        {
+            return _hwa.read32(page, offset, data);
+        };
+
+        return parseRecords(page, handler, readFlash, start);
+    }
+
+    template<typename HwaImpl>
+    template<typename Handler, typename Reader>
+    uint32_t BasicEmuEEPROM<HwaImpl>::parseRecords(page_t page, Handler&& handler, Reader&& readWord, uint32_t start)
+    {
+        const uint32_t SIZE   = pageSize(page);
+        uint32_t       offset = start;
+
+        while (offset < SIZE)
+        {
+            uint32_t data;
+            Record   record;
+
+            if (!readWord(offset, data))
+            {
+                offset += 4;
+                continue;
+            }
+
+            if (data == 0xFFFFFFFF)
+            {
+                break;    // end of written data
+            }
+
+            record.offset = offset;
+
+            if ((data >> 16) != 0xFFFF)
+            {
+                offset += 4;
+                record.address = data >> 16;
+                record.value   = data & 0xFFFF;
+
+                if (!handler(record))
+                {
+                    break;
+                }
+
+                continue;
+            }
+
+            // extended or special record: second word holds the address (or its lower half) and value
+            const uint16_t TYPE        = data & 0xFFFF;
+            const uint32_t RECORD_SIZE = recordSize(data);
+            uint32_t       payload     = 0xFFFFFFFF;
+
+            if ((offset + 4) < SIZE)
+            {
+                readWord(offset + 4, payload);
+            }
+
+            if (TYPE < SPECIAL_RECORD)
+            {
+                record.address = static_cast<uint32_t>(TYPE) << 16 | payload >> 16;
+                record.value   = payload & 0xFFFF;
+            }
+            else if (TYPE == COUNTER_RECORD)
+            {
+                record.type    = recordType_t::COUNTER;
+                record.address = payload >> 16;
+                record.value   = payload & 0xFFFF;
+
+                for (uint32_t i = offset + 8; (i < (offset + RECORD_SIZE)) && (i < SIZE); i += 4)
+                {
+                    uint32_t bits = 0xFFFFFFFF;
+                    readWord(i, bits);
+                    record.value += std::bitset<32>(~bits).count();
+                }
+            }
+            else if (TYPE == FLAGS_RECORD)
+            {
+                record.type    = recordType_t::FLAGS;
+                record.address = payload >> 16;
+                record.value   = payload & 0xFFFF;
+            }
+            else if (TYPE == TOMBSTONE_RECORD)
+            {
+                record.type    = recordType_t::TOMBSTONE;
+                record.address = payload;
+                record.count   = 0xFFFFFFFF;
+
+                if ((offset + 8) < SIZE)
+                {
+                    readWord(offset + 8, record.count);
+                }
+
+                // count is written last
+                if (record.count == 0xFFFFFFFF)
+                {
+                    payload = 0xFFFFFFFF;
+                }
+            }
+            else if (TYPE == TRANSFER_RECORD)
+            {
+                record.type    = recordType_t::TRANSFER;
+                record.address = 0xFFFFFFFF;
+                record.count   = payload;
+            }
+            else if (TYPE == LAYOUT_RECORD)
+            {
+                record.type    = recordType_t::LAYOUT;
+                record.address = 0xFFFFFFFF;
+                record.count   = payload & 0xFFFF;
+            }
+            else
+            {
+                // unknown record type
+                offset += 4;
+                continue;
+            }
+
+            offset += RECORD_SIZE;
+
+            if (payload == 0xFFFFFFFF)
+            {
+                continue;    // write interrupted after the marker
+            }
+
+            if (!handler(record))
+            {
+                break;
+            }
+        }
+
+        return std::min(offset, SIZE);
+    }
+
+    /// Returns size in bytes of the record starting with given word.
+    /// Records of unknown type are taken as single words.
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::recordSize(uint32_t data)
+    {
+        if ((data >> 16) != 0xFFFF)
+        {
+            return 4;
+        }
+
+        switch (data & 0xFFFF)
+        {
+        case COUNTER_RECORD:
+            return (2 + COUNTER_WORDS) * 4;
+
+        case TOMBSTONE_RECORD:
+            return TOMBSTONE_SIZE;
+
+        case FLAGS_RECORD:
+        case TRANSFER_RECORD:
+        case LAYOUT_RECORD:
+            return 8;
+
+        default:
+            return (data & 0xFFFF) < SPECIAL_RECORD ? 8 : 4;
+        }
+    }
+
+    /// Returns offset of the first blank word following the written records.
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::findEndOfData(page_t page)
+    {
+        auto skipRecord = [](const Record&)
+        {
+            return true;
+        };
+
+        const uint32_t* words = _hwa.pageAddress(page);
+
+        if (words == nullptr)
+        {
+            return parsePage(page, skipRecord);
+        }
+
+        auto stopRecord = [](const Record&)
+        {
+            return false;
+        };
+
+        const uint32_t END   = pageSize(page) / 4;
+        uint32_t       index = sizeof(pageStatus_t) / 4;
+
+        while (true)
+        {
+            // single-word records are skipped over in memory,
+            // while the record with a marker (or blank word) stopping the scan is parsed normally
+            index = firstMarkedWord(words, index, END);
+
+            if ((index == END) || (words[index] == 0xFFFFFFFF))
+            {
+                return index * 4;
+            }
+
+            index = parsePage(page, stopRecord, index * 4) / 4;
+        }
+    }
+
+    /// Returns index of the first word in range [index, end) with all upper 16 bits set, or end if there is none.
+    /// Such word is either blank or a marker of multi-word record, all other words are single-word records.
+    /// Four words are compared at once without branching between them so that the compiler
+    /// can turn the check into a single vector compare.
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::firstMarkedWord(const uint32_t* words, uint32_t index, uint32_t end)
+    {
+        for (; (index + 4) <= end; index += 4)
+        {
+            if (((words[index] >> 16) == 0xFFFF) | ((words[index + 1] >> 16) == 0xFFFF) | ((words[index + 2] >> 16) == 0xFFFF) | ((words[index + 3] >> 16) == 0xFFFF))
+            {
+                break;
+            }
+        }
+
+        for (; index < end; index++)
+        {
+            if ((words[index] >> 16) == 0xFFFF)
+            {
+                break;
+            }
+        }
+
+        return index;
+    }
+
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::definePartitions(const uint32_t* sizes, uint8_t count)
+    {
+        if (count > _partitions.size())
+        {
+            return false;
+        }
+
+        uint32_t start = 0;
+
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (sizes[i] > (maxAddress() - start))
+            {
+                return false;
+            }
+
+            _partitions[i].start = start;
+            _partitions[i].size  = sizes[i];
+            start += sizes[i];
+        }
+
+        _partitionCount = count;
+
+        return true;
+    }
+
+    template<typename HwaImpl>
+    typename BasicEmuEEPROM<HwaImpl>::Partition BasicEmuEEPROM<HwaImpl>::partition(uint8_t index)
+    {
+        return Partition(*this, index);
+    }
+
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::clearRange(uint32_t first, uint32_t count, bool restoreFactory)
+    {
+        RetainedGuard guard(*this);
+        const bool    RESTORE = restoreFactory && _useFactoryPage && (pageStatus(page_t::PAGE_FACTORY) == pageStatus_t::VALID);
+
+        // cleared variables which are already copied can't be taken back from the new page
+        if (completeCopy() != writeStatus_t::OK)
+        {
+            return false;
+        }
+
+        if constexpr (BOUNDED_CACHE)
+        {
+            for (auto& entry : _lru)
+            {
+                if ((entry.address >= first) && (entry.address < (first + count)))
+                {
+                    entry = CacheEntry();
+                }
+            }
+
+            // cleared variables are skipped while copying the page
+            _dropFirst = first;
+            _dropCount = count;
+
+            const bool TRANSFERRED = pageTransfer() == writeStatus_t::OK;
+
+            _dropCount = 0;
+
+            if (!TRANSFERRED)
+            {
+                return false;
+            }
+
+            if (RESTORE)
+            {
+                bool restored = true;
+
+                // factory page is written in order, so later entries override earlier ones
+                auto restoreRecord = [this, first, count, &restored](const Record& record)
+                {
+                    if ((record.type != recordType_t::TOMBSTONE) && (record.address >= first) && (record.address < (first + count)))
+                    {
+                        restored = writeWithTransfer(record.address, record.value, false) == writeStatus_t::OK;
+                    }
+
+                    return restored;
+                };
+
+                parsePage(page_t::PAGE_FACTORY, restoreRecord);
+
+                return restored;
+            }
+
+            return true;
+        }
+
+        // dirty flags and retained copy are cleared along with the values
+        removeCached(first, count, 0);
+
+        if (RESTORE)
+        {
+            // factory page is written in order, so later entries override earlier ones
+            auto restoreRecord = [this, first, count](const Record& record)
+            {
+                if ((record.type != recordType_t::TOMBSTONE) && (record.address >= first) && (record.address < (first + count)))
+                {
+                    setCache(record.address, record.value);
+                }
+
+                return true;
+            };
+
+            parsePage(page_t::PAGE_FACTORY, restoreRecord);
+        }
+
+        // cleared variables are dropped once cache is dumped to the new page
+        return pageTransfer() == writeStatus_t::OK;
+    }
+
+    template<typename HwaImpl>
+    readStatus_t BasicEmuEEPROM<HwaImpl>::Partition::read(uint32_t address, uint16_t& data)
+    {
+        if (address >= size())
+        {
+            return readStatus_t::READ_ERROR;
+        }
+
+        return _emuEEPROM.read(_emuEEPROM._partitions[_index].start + address, data);
+    }
+
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::Partition::write(uint32_t address, uint16_t data, bool cacheOnly)
+    {
+        if (address >= size())
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        return _emuEEPROM.write(_emuEEPROM._partitions[_index].start + address, data, cacheOnly);
+    }
+
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::Partition::clear()
+    {
+        if (_index >= _emuEEPROM._partitionCount)
+        {
+            return false;
+        }
+
+        // no need for page transfer, tombstone is enough
+        return _emuEEPROM.removeRange(_emuEEPROM._partitions[_index].start, size()) == writeStatus_t::OK;
+    }
+
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::Partition::format()
+    {
+        TraceScope scope(_emuEEPROM, traceOp_t::FORMAT_PARTITION, _index);
+
+        if (_index >= _emuEEPROM._partitionCount)
+        {
+            return false;
+        }
+
+        return _emuEEPROM.clearRange(_emuEEPROM._partitions[_index].start, size(), true);
+    }
+
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::Partition::size() const
+    {
+        // undefined partitions have no space
+        return _index < _emuEEPROM._partitionCount ? _emuEEPROM._partitions[_index].size : 0;
+    }
+
+    /// Reserve has to fit into either page next to the variables in use, so that it stays free after page transfer.
+    /// With bounded cache, variables in use are known only once they're copied, so that's checked on each transfer
+    /// as well: writes return PAGE_FULL if the reserve no longer fits.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::setFlushReserve(uint32_t records)
+    {
+        const uint32_t OLD_RESERVE = _flushReserve;
+
+        _flushReserve = records;
+
+        if (!reserveFits(transferSize()))
+        {
+            _flushReserve = OLD_RESERVE;
+            return false;
+        }
+
+        return true;
+    }
+
+    /// Returns amount of bytes page transfer writes to the new page: header, layout record,
+    /// variables in use and transfer record. Variables aren't known with bounded cache and are left out.
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::transferSize() const
+    {
+        uint32_t size = sizeof(pageStatus_t) + (TRANSFER_WORDS * 4);
+
+        if (_cachedLayout)
+        {
+            size += 8;
+        }
+
+        if constexpr (!BOUNDED_CACHE)
+        {
+            for (uint32_t i = 0; i < MAX_ADDRESS; i++)
+            {
+                if (_eepromCache[i] != 0xFFFF)
+                {
+                    size += i >= 0xFFFF ? 8 : 4;
+                }
+            }
+        }
+
+        return size;
+    }
+
+    /// Checks whether flush reserve and at least one record for normal writes fit into either page
+    /// after given amount of bytes is used.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::reserveFits(uint32_t used) const
+    {
+        const uint64_t NEEDED = static_cast<uint64_t>(used) + ((static_cast<uint64_t>(_flushReserve) + 1) * 4);
+
+        return NEEDED <= std::min(pageSize(page_t::PAGE_1), pageSize(page_t::PAGE_2));
+    }
+
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::emergencyFlush()
+    {
+        TraceScope scope(*this, traceOp_t::EMERGENCY_FLUSH);
+
+        // writes variables stored only in cache to the reserved space of the active page
+        // no page transfer and no erase is performed here: if there is not enough space
+        // for everything, PAGE_FULL is returned and the rest remains in cache
+        if constexpr (BOUNDED_CACHE)
+        {
+            for (const auto& entry : _lru)
+            {
+                if (!entry.dirty)
+                {
+                    continue;
+                }
+
+                auto status = writeInternal(entry.address, entry.value, false, true);
+
+                if (status != writeStatus_t::OK)
+                {
+                    return status;
+                }
+            }
+
+            return writeStatus_t::OK;
+        }
+
+        for (uint32_t i = 0; i < _dirty.size(); i++)
+        {
+            for (uint32_t bit = 0; _dirty[i] && (bit < 32); bit++)
+            {
+                if (!(_dirty[i] & (1UL << bit)))
+                {
+                    continue;
+                }
+
+                uint32_t address = (i * 32) + bit;
+                auto     status  = writeInternal(address, _eepromCache[address], false, true);
+
+                if (status != writeStatus_t::OK)
+                {
+                    return status;
+                }
+            }
+        }
+
+        return writeStatus_t::OK;
+    }
+
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::setDirty(uint32_t address, bool state)
+    {
+        if (state)
+        {
+            _dirty[address / 32] |= 1UL << (address % 32);
+        }
+        else
+        {
+            _dirty[address / 32] &= ~(1UL << (address % 32));
+        }
+
+        if (_retained != nullptr)
+        {
+            const uint32_t INDEX = address / 32;
+
+            _retainedSum += CHECKSUM_WORD(MAX_ADDRESS + INDEX, _dirty[INDEX]) - CHECKSUM_WORD(MAX_ADDRESS + INDEX, _retained->dirty[INDEX]);
+            _retained->dirty[INDEX] = _dirty[INDEX];
+        }
+    }
+
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::setCache(uint32_t address, uint16_t value)
+    {
+        _eepromCache[address] = value;
+
+        if (_retained != nullptr)
+        {
+            _retainedSum += CHECKSUM_WORD(address, value) - CHECKSUM_WORD(address, _retained->cache[address]);
+            _retained->cache[address] = value;
+        }
+    }
+
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::resetCache()
+    {
+        std::fill(_eepromCache.begin(), _eepromCache.end(), 0xFFFF);
+        _dirty.fill(0);
+        _lru.fill(CacheEntry());
+        _offsetIndex.fill(0);
+        _bitRecords.fill(BitRecord());
+        _keyIndex.fill(0);
+        _freeKeySlot    = 0;
+        _generation     = 0;
+        _transferOffset = 0;
+        _cachedLayout   = 0;
+        _resync         = true;
+    }
+
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::defineKeys(uint32_t slots)
+    {
+        if (slots > EMU_EEPROM_MAX_KEYS)
+        {
+            return false;
+        }
+
+        // key-value slots must not overlap with partitions
+        const uint32_t PARTITIONS_END = _partitionCount ? _partitions[_partitionCount - 1].start + _partitions[_partitionCount - 1].size : 0;
+
+        if (PARTITIONS_END > (MAX_ADDRESS - (slots * KEY_SLOT_SIZE)))
+        {
+            return false;
+        }
+
+        _keySlots = slots;
+        rebuildKeyIndex();
+
+        return true;
+    }
+
+    template<typename HwaImpl>
+    readStatus_t BasicEmuEEPROM<HwaImpl>::readKey(uint32_t key, uint16_t& data)
+    {
+        TraceScope scope(*this, traceOp_t::READ_KEY, key);
+
+        uint32_t slot;
+
+        if (!findKey(key, slot))
+        {
+            return readStatus_t::NO_VAR;
+        }
+
+        return readInternal(keySlotAddress(slot) + 2, data);
+    }
+
+    template<typename HwaImpl>
+    readStatus_t BasicEmuEEPROM<HwaImpl>::readKey(const char* key, uint16_t& data)
+    {
+        return readKey(KEY_HASH(key), data);
+    }
+
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::writeKey(uint32_t key, uint16_t data, bool cacheOnly)
+    {
+        TraceScope scope(*this, cacheOnly ? traceOp_t::WRITE_KEY_CACHE_ONLY : traceOp_t::WRITE_KEY, key, data);
+
+        // 0xFFFF in either half of the key can't be told apart from an unused slot
+        if (((key >> 16) == 0xFFFF) || ((key & 0xFFFF) == 0xFFFF))
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        uint32_t slot;
+
+        if (findKey(key, slot))
+        {
+            return writeWithTransfer(keySlotAddress(slot) + 2, data, cacheOnly);
+        }
+
+        if (_freeKeySlot >= _keySlots)
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        slot = _freeKeySlot;
+
+        const uint32_t                            ADDRESS = keySlotAddress(slot);
+        const std::array<uint16_t, KEY_SLOT_SIZE> RECORDS = {
+            static_cast<uint16_t>(key >> 16),
+            static_cast<uint16_t>(key & 0xFFFF),
+            data,
+        };
+
+        // new key: value is written first and key halves last so that
+        // the slot is considered used only once everything is in place
+        for (uint32_t i = KEY_SLOT_SIZE; i-- > 0;)
+        {
+            auto status = writeWithTransfer(ADDRESS + i, RECORDS[i], cacheOnly);
+
+            if (status != writeStatus_t::OK)
+            {
+                return status;
+            }
+        }
+
+        insertKey(key, slot);
+
+        while ((_freeKeySlot < _keySlots) && (cacheValue(keySlotAddress(_freeKeySlot)) != 0xFFFF) && (cacheValue(keySlotAddress(_freeKeySlot) + 1) != 0xFFFF))
+        {
+            _freeKeySlot++;
+        }
+
+        return writeStatus_t::OK;
+    }
+
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::writeKey(const char* key, uint16_t data, bool cacheOnly)
+    {
+        return writeKey(KEY_HASH(key), data, cacheOnly);
+    }
+
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::rebuildKeyIndex()
+    {
+        _keyIndex.fill(0);
+        _freeKeySlot = _keySlots;
+
+        for (uint32_t slot = 0; slot < _keySlots; slot++)
+        {
+            const uint16_t HIGH = cacheValue(keySlotAddress(slot));
+            const uint16_t LOW  = cacheValue(keySlotAddress(slot) + 1);
+
+            if ((HIGH == 0xFFFF) || (LOW == 0xFFFF))
+            {
+                // unused or partially written slot
+                _freeKeySlot = std::min(_freeKeySlot, slot);
+                continue;
+            }
+
+            insertKey(static_cast<uint32_t>(HIGH) << 16 | LOW, slot);
+        }
+    }
+
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::insertKey(uint32_t key, uint32_t slot)
+    {
+        // linear probing:
+        // index is at least twice as large as there are slots, so free entry is always found
+        const uint32_t MASK  = KEY_INDEX_SIZE() - 1;
+        uint32_t       index = keyIndexStart(key);
+
+        while (_keyIndex[index])
+        {
+            index = (index + 1) & MASK;
+        }
+
+        _keyIndex[index] = slot + 1;
+    }
+
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::findKey(uint32_t key, uint32_t& slot)
+    {
+        const uint32_t MASK  = KEY_INDEX_SIZE() - 1;
+        uint32_t       index = keyIndexStart(key);
+
+        for (uint32_t i = 0; (i < KEY_INDEX_SIZE()) && _keyIndex[index]; i++)
+        {
+            slot = _keyIndex[index] - 1;
+
+            const uint32_t ADDRESS = keySlotAddress(slot);
+
+            if ((static_cast<uint32_t>(cacheValue(ADDRESS)) << 16 | cacheValue(ADDRESS + 1)) == key)
+            {
+                return true;
+            }
+
+            index = (index + 1) & MASK;
+        }
+
+        return false;
+    }
+
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::keyIndexStart(uint32_t key)
+    {
+        const uint32_t HASH = static_cast<uint32_t>(key * 2654435769UL);
+        return (HASH ^ (HASH >> 16)) & (KEY_INDEX_SIZE() - 1);
+    }
+
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::keySlotAddress(uint32_t slot) const
+    {
+        return MAX_ADDRESS - ((slot + 1) * KEY_SLOT_SIZE);
+    }
+
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::readGeometry()
+    {
+        for (auto page : { page_t::PAGE_1, page_t::PAGE_2, page_t::PAGE_FACTORY })
+        {
+            const uint32_t SIZE = _hwa.pageSize(page);
+
+            if (SIZE % 4)
+            {
+                return false;
+            }
+
+            if (page == page_t::PAGE_FACTORY)
+            {
+                // factory page only holds the image copied on format, so it can be smaller
+                _pageSize[static_cast<uint8_t>(page)] = SIZE;
+                continue;
+            }
+
+            // EMU_EEPROM_PAGE_SIZE determines the address space, which has to fit into either page
+            if (SIZE < EMU_EEPROM_PAGE_SIZE)
+            {
+                return false;
+            }
+
+            // offset index holds 16-bit word indexes
+            if (BOUNDED_CACHE && ((SIZE / 4) > 0x10000))
+            {
+                return false;
+            }
+
+            _pageSize[static_cast<uint8_t>(page)] = SIZE;
+        }
+
+        _dualBank = _hwa.bank(page_t::PAGE_1) != _hwa.bank(page_t::PAGE_2);
+
+        return true;
+    }
+
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::pageSize(page_t page) const
+    {
+        return _pageSize[static_cast<uint8_t>(page)];
+    }
+
+    /// Pages spanning several sectors are erased one sector at a time.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::erase(page_t page)
+    {
+        const uint32_t SECTORS = _hwa.sectorCount(page);
+
+        for (uint32_t i = 0; i < SECTORS; i++)
+        {
+            _usage.erased++;
+
+            if (!_hwa.eraseSector(page, i))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /// Schedules erase of the old page once all the variables are copied to the new one,
+    /// or of the new page once the transfer is aborted. Page is erased one sector at a time,
+    /// in the background with pages in separate banks, or in place on each compact() call otherwise.
+    /// Transfer is completed when the erase is, see serviceErase().
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::startErase(page_t page, bool discard)
+    {
+        _erase         = EraseState();
+        _erase.page    = page;
+        _erase.active  = true;
+        _erase.discard = discard;
+    }
+
+    /// Starts erasing the next sector once the bank is done with the previous one,
+    /// and completes the page transfer after the last one.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::serviceErase()
+    {
+        if (!_erase.active || _hwa.busy(_erase.page))
+        {
+            return true;
+        }
+
+        if (_erase.sector < _hwa.sectorCount(_erase.page))
+        {
+            _usage.erased++;
+
+            if (!_hwa.startEraseSector(_erase.page, _erase.sector++))
+            {
+                // try to finish the job without background erase
+                _erase.active = false;
+                return erase(_erase.page) && completeErase();
+            }
+
+            // erase done in place doesn't need another call to complete the transfer
+            if ((_erase.sector < _hwa.sectorCount(_erase.page)) || _hwa.busy(_erase.page))
+            {
+                return true;
+            }
+        }
+
+        _erase.active = false;
+        return completeErase();
+    }
+
+    /// Marks the erased page as formatted, completing the page transfer unless the page was discarded.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::completeErase()
+    {
+        if (_erase.discard)
+        {
+            return program(_erase.page, 0, static_cast<uint32_t>(pageStatus_t::FORMATTED));
+        }
+
+        return completeTransfer(_erase.page);
+    }
+
+    /// Waits until the background erase is done.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::finishErase()
+    {
+        while (_erase.active)
+        {
+            if (!serviceErase())
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /// Marks erased old page as formatted and the new one as valid.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::completeTransfer(page_t oldPage)
+    {
+        const page_t NEW_PAGE = oldPage == page_t::PAGE_1 ? page_t::PAGE_2 : page_t::PAGE_1;
+
+        _restamp = true;
+
+        if (!program(oldPage, 0, static_cast<uint32_t>(pageStatus_t::FORMATTED)))
+        {
+            return false;
+        }
+
+        return program(NEW_PAGE, 0, static_cast<uint32_t>(pageStatus_t::VALID));
+    }
+
+    /// Repairs page transfer interrupted by power loss.
+    /// New page is taken over if all the variables got copied to it: it has the transfer record, or the old page
+    /// is no longer valid, as it's erased only once everything is copied. Otherwise new page is discarded.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::recoverTransfer(page_t newPage)
+    {
+        const page_t OLD_PAGE = newPage == page_t::PAGE_1 ? page_t::PAGE_2 : page_t::PAGE_1;
+        uint32_t     generation;
+
+        if (pageGeneration(newPage, generation) || (pageStatus(OLD_PAGE) != pageStatus_t::VALID))
+        {
+            // old page might have been erased partially
+            return erase(OLD_PAGE) && completeTransfer(OLD_PAGE);
+        }
+
+        // transfer will be repeated once the old page fills up again
+        if (!erase(newPage))
+        {
+            return false;
+        }
+
+        return program(newPage, 0, static_cast<uint32_t>(pageStatus_t::FORMATTED));
+    }
+
+    /// Marks the end of copied variables in the page being transferred to.
+    /// There might be no space left for it if the entire address space is in use.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::writeTransferRecord()
+    {
+        page_t   page;
+        uint32_t offset;
+
+        if (allocate(TRANSFER_WORDS * 4, true, page, offset) != writeStatus_t::OK)
+        {
+            return false;
+        }
+
+        if (!program(page, offset, EXTENDED_MARKER | TRANSFER_RECORD))
+        {
+            return false;
+        }
+
+        _nextOffsetToWrite = offset + (TRANSFER_WORDS * 4);
+
+        if (!program(page, offset + 4, _generation + 1))
+        {
+            return false;
+        }
+
+        _generation++;
+        _transferOffset = offset;
+        return true;
+    }
+
+    /// Returns generation of the page, which increases with each transfer.
+    /// Returns false for pages without complete transfer record, such as formatted ones.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::pageGeneration(page_t page, uint32_t& generation)
+    {
+        bool found = false;
+
+        auto findTransfer = [&generation, &found](const Record& record)
+        {
+            if (record.type == recordType_t::TRANSFER)
+            {
+                generation = record.count;
+                found      = true;
+                return false;
+            }
+
+            return true;
+        };
+
+        parsePage(page, findTransfer);
+
+        return found;
+    }
+
+    /// Brings cached variables to the layout version set with defineLayout() and marks the records
+    /// written from here on as being in it. Records already on flash are left for the next page transfer.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::updateLayout(bool migrate)
+    {
+        // variables written by newer firmware are used as they are
+        if (_layoutVersion <= _cachedLayout)
+        {
+            return true;
+        }
+
+        if (migrate)
+        {
+            migrateCache(_cachedLayout, _layoutVersion);
+        }
+
+        _cachedLayout = _layoutVersion;
+
+        page_t   page;
+        uint32_t offset;
+
+        auto status = allocate(8, false, page, offset);
+
+        // new page starts with the layout record anyway
+        if (status == writeStatus_t::PAGE_FULL)
+        {
+            return pageTransfer() == writeStatus_t::OK;
+        }
+
+        return (status == writeStatus_t::OK) && writeLayoutRecord(page, _nextOffsetToWrite);
+    }
+
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::writeLayoutRecord(page_t page, uint32_t& offset)
+    {
+        if (!program(page, offset, EXTENDED_MARKER | LAYOUT_RECORD))
+        {
+            return false;
+        }
+
+        // once the marker is in place, its second word is used up even if writing it fails
+        offset += 8;
+
+        return program(page, offset - 4, _cachedLayout);
+    }
+
+    /// Applies migrations of the layout versions after from, up to and including to, on the cache.
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::migrateCache(uint16_t from, uint16_t to)
+    {
+        if constexpr (!BOUNDED_CACHE)
+        {
+            std::array<uint16_t, EMU_EEPROM_MAX_MIGRATIONS> values;
+
+            for (uint32_t version = from + 1; version <= to; version++)
+            {
+                // all the values are taken out before any is put back, so that variables can move onto each other
+                for (uint32_t i = 0; i < _migrationCount; i++)
+                {
+                    const auto& migration = _migrations[i];
+
+                    values[i] = 0xFFFF;
+
+                    if ((migration.version == version) && (migration.from < MAX_ADDRESS))
+                    {
+                        values[i] = _eepromCache[migration.from];
+                    }
+                }
+
+                for (uint32_t i = 0; i < _migrationCount; i++)
+                {
+                    if ((_migrations[i].version == version) && (_migrations[i].from < MAX_ADDRESS))
+                    {
+                        _eepromCache[_migrations[i].from] = 0xFFFF;
+                    }
+                }
+
+                for (uint32_t i = 0; i < _migrationCount; i++)
+                {
+                    const auto& migration = _migrations[i];
+
+                    if ((migration.version != version) || (migration.to >= MAX_ADDRESS) || (values[i] == 0xFFFF))
+                    {
+                        continue;
+                    }
+
+                    _eepromCache[migration.to] = migration.transform != nullptr ? migration.transform(values[i]) : values[i];
+                }
+            }
+
+            // counters and flags on flash are in older layout, so they're continued in new records
+            if (from < to)
+            {
+                _bitRecords.fill(BitRecord());
+            }
+        }
+    }
+
+    /// Checks whether migrations after layout version from, up to and including to, move the variable
+    /// at given address elsewhere or another one onto it.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::remapped(uint32_t address, uint16_t from, uint16_t to) const
+    {
+        for (uint32_t i = 0; i < _migrationCount; i++)
+        {
+            const auto& migration = _migrations[i];
+
+            if ((migration.version > from) && (migration.version <= to) && ((migration.from == address) || (migration.to == address)))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /// Returns current value of the variable or 0xFFFF if it doesn't exist.
+    template<typename HwaImpl>
+    uint16_t BasicEmuEEPROM<HwaImpl>::cacheValue(uint32_t address)
+    {
+        if constexpr (BOUNDED_CACHE)
+        {
+            uint16_t data;
+            return readInternal(address, data) == readStatus_t::OK ? data : 0xFFFF;
+        }
+
+        return _eepromCache[address];
+    }
+
+    template<typename HwaImpl>
+    typename BasicEmuEEPROM<HwaImpl>::CacheEntry* BasicEmuEEPROM<HwaImpl>::findEntry(uint32_t address)
+    {
+        for (auto& entry : _lru)
+        {
+            if (entry.address == address)
+            {
+                return &entry;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /// Looks up the variable in bounded cache and marks it as the most recently used one.
+    /// If it isn't there and allocate is set, least recently used entry which isn't dirty is taken over.
+    template<typename HwaImpl>
+    typename BasicEmuEEPROM<HwaImpl>::CacheEntry* BasicEmuEEPROM<HwaImpl>::touchEntry(uint32_t address, bool allocate)
+    {
+        auto entry = findEntry(address);
+
+        if (entry == nullptr)
+        {
+            if (!allocate)
+            {
+                return nullptr;
+            }
+
+            for (size_t i = _lru.size(); i-- > 0;)
+            {
+                if (!_lru[i].dirty)
+                {
+                    entry = &_lru[i];
+                    break;
+                }
+            }
+
+            if (entry == nullptr)
+            {
+                return nullptr;
+            }
+
+            *entry         = CacheEntry();
+            entry->address = address;
+        }
+
+        std::rotate(_lru.begin(), _lru.begin() + (entry - _lru.data()), _lru.begin() + (entry - _lru.data()) + 1);
+
+        return _lru.data();
+    }
+
+    /// Looks up the latest record of the variable on flash.
+    /// Index holds the latest record of any address mapped to the same bucket,
+    /// so the search starts there instead of at the end of written data.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::findOnFlash(page_t page, uint32_t address, uint16_t& data)
+    {
+        bool found = false;
+
+        auto findRecord = [address, &data, &found](const Record& record)
+        {
+            if (record.type == recordType_t::TOMBSTONE)
+            {
+                // removed, older records don't matter
+                return (address < record.address) || ((address - record.address) >= record.count);
+            }
+
+            if (record.address == address)
+            {
+                data  = record.value;
+                found = true;
+                return false;
+            }
+
+            return true;
+        };
+
+        parsePageBackward(page, _offsetIndex[address & (EMU_EEPROM_INDEX_SIZE - 1)], findRecord);
+
+        return found;
+    }
+
+    /// Copies the latest record of each variable from old page to the one being transferred to,
+    /// with values of cache-only writes taking precedence.
+    /// Old page is scanned from the end, so the first record found for an address is the latest one
+    /// and a single bit per address is enough to skip the older ones.
+    /// Returns amount of words programmed. Without write, they're only counted.
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::copyLatest(page_t oldPage, uint32_t end, bool write)
+    {
+        uint32_t words = 0;
+
+        auto transferred = [this](uint32_t address)
+        {
+            const bool STATE = _transferred[address / 32] & (1UL << (address % 32));
+            _transferred[address / 32] |= 1UL << (address % 32);
+            return STATE;
+        };
+
+        _transferred.fill(0);
+
+        if (write)
+        {
+            _offsetIndex.fill(0);
+        }
+
+        for (uint32_t i = _dropFirst; i < (_dropFirst + _dropCount); i++)
+        {
+            transferred(i);
+        }
+
+        auto copyRecord = [this, write, &words, &transferred](const Record& record)
+        {
+            if (record.type == recordType_t::TOMBSTONE)
+            {
+                // older records of removed variables are skipped
+                for (uint32_t i = record.address; (i < MAX_ADDRESS) && ((i - record.address) < record.count); i++)
+                {
+                    transferred(i);
+                }
+
+                return true;
+            }
+
+            if ((record.address >= MAX_ADDRESS) || transferred(record.address))
+            {
+                return true;
+            }
+
+            uint16_t value = record.value;
+
+            if (auto entry = findEntry(record.address); (entry != nullptr) && entry->dirty)
+            {
+                value = entry->value;
+            }
+
+            if (value != 0xFFFF)
+            {
+                words++;
+
+                if (write)
+                {
+                    writeInternal(record.address, value, false, true);
+                }
+            }
+
+            return true;
+        };
+
+        parsePageBackward(oldPage, (end / 4) - 1, copyRecord);
+
+        // cache-only variables which weren't on flash at all, or were written after being removed
+        for (auto& entry : _lru)
+        {
+            if (entry.dirty && (entry.value != 0xFFFF))
+            {
+                words++;
+
+                if (write)
+                {
+                    writeInternal(entry.address, entry.value, false, true);
+                }
+            }
+
+            if (write)
+            {
+                entry.dirty = false;
+            }
+        }
+
+        return words;
+    }
+
+    /// Walks over records in page backwards, from word at index start down to the page header,
+    /// and calls handler(record) for each of them until it returns false.
+    /// Used with bounded cache, where page holds only single-word records and tombstones.
+    template<typename HwaImpl>
+    template<typename Handler>
+    void BasicEmuEEPROM<HwaImpl>::parsePageBackward(page_t page, uint32_t start, Handler&& handler)
+    {
+        const uint32_t* words = _hwa.pageAddress(page);
+
+        // unreadable words are treated as blank ones
+        auto readWord = [this, page, words](uint32_t index)
+        {
+            uint32_t data = 0xFFFFFFFF;
+
+            if (index == 0)
+            {
+                return data;    // header
+            }
+
+            if (words != nullptr)
+            {
+                return words[index];
+            }
+
+            _hwa.read32(page, index * 4, data);
+            return data;
+        };
+
+        const uint32_t MARKER          = EXTENDED_MARKER | TOMBSTONE_RECORD;
+        const uint32_t TRANSFER_MARKER = EXTENDED_MARKER | TRANSFER_RECORD;
+        const uint32_t LAYOUT_MARKER   = EXTENDED_MARKER | LAYOUT_RECORD;
+
+        // words at index +2, +1, 0, -1 and -2 relative to the current one:
+        // tombstone, transfer and layout record contents can only be told apart from regular records by the marker preceding them
+        std::array<uint32_t, 5> window = {
+            0xFFFFFFFF,
+            0xFFFFFFFF,
+            readWord(start),
+            start >= 1 ? readWord(start - 1) : 0xFFFFFFFF,
+            start >= 2 ? readWord(start - 2) : 0xFFFFFFFF,
+        };
+
+        for (uint32_t i = start; i > 0; i--)
+        {
+            Record record;
+            record.offset = i * 4;
+
+            if (window[2] == MARKER)
+            {
+                if ((window[1] != 0xFFFFFFFF) && (window[0] != 0xFFFFFFFF))
+                {
+                    record.type    = recordType_t::TOMBSTONE;
+                    record.address = window[1];
+                    record.count   = window[0];
+
+                    if (!handler(record))
+                    {
+                        return;
+                    }
+                }
+            }
+            else if (((window[2] >> 16) != 0xFFFF) && (window[3] != MARKER) && (window[3] != TRANSFER_MARKER) && (window[3] != LAYOUT_MARKER) && (window[4] != MARKER))
+            {
+                record.address = window[2] >> 16;
+                record.value   = window[2] & 0xFFFF;
+
+                if (!handler(record))
+                {
+                    return;
+                }
+            }
+
+            std::rotate(window.begin(), window.begin() + 1, window.end());
+            window[4] = i >= 3 ? readWord(i - 3) : 0xFFFFFFFF;
+        }
+    }
+
+    /// Removes single variable, see removeRange().
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::remove(uint32_t address)
+    {
+        return removeRange(address, 1);
+    }
+
+    /// Removes count variables starting with first.
+    /// Tombstone record is written so that older records of removed variables are ignored
+    /// until the next page transfer, which drops both of them.
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::removeRange(uint32_t first, uint32_t count)
+    {
+        TraceScope scope(*this, traceOp_t::REMOVE, first, count);
+
+        RetainedGuard guard(*this);
+
+        if ((first >= maxAddress()) || (count > (maxAddress() - first)))
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        if (!count)
+        {
+            return writeStatus_t::OK;
+        }
+
+        // tombstone has to land on the page which already holds the removed variables
+        if (auto status = completeCopy(); status != writeStatus_t::OK)
+        {
+            return status;
+        }
+
+        page_t   validPage;
+        uint32_t offset;
+        auto     status = allocate(TOMBSTONE_SIZE, false, validPage, offset);
+
+        if (status == writeStatus_t::PAGE_FULL)
+        {
+            // tombstone isn't needed when variables aren't copied to the new page in the first place
+            removeCached(first, count, 0);
+
+            if constexpr (BOUNDED_CACHE)
+            {
+                _dropFirst = first;
+                _dropCount = count;
+            }
+
+            status     = pageTransfer();
+            _dropCount = 0;
+
+            return status;
+        }
+
+        if (status != writeStatus_t::OK)
+        {
+            return status;
+        }
+
+        if (!program(validPage, offset, EXTENDED_MARKER | TOMBSTONE_RECORD))
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        // once the marker is in place, the entire record is used up even if writing the rest fails
+        _nextOffsetToWrite = offset + TOMBSTONE_SIZE;
+
+        if (!program(validPage, offset + 4, first) || !program(validPage, offset + 8, count))
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        removeCached(first, count, offset);
+
+        return writeStatus_t::OK;
+    }
+
+    /// Drops removed variables from RAM.
+    /// With bounded cache, index buckets of removed variables are pointed to the tombstone at given offset
+    /// (if any) so that lookups don't skip it.
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::removeCached(uint32_t first, uint32_t count, uint32_t offset)
+    {
+        const uint32_t END = first + std::min(count, MAX_ADDRESS - std::min(first, MAX_ADDRESS));
+
+        if constexpr (BOUNDED_CACHE)
+        {
+            for (auto& entry : _lru)
+            {
+                if ((entry.address >= first) && (entry.address < END))
+                {
+                    entry = CacheEntry();
+                }
+            }
+
+            // tombstone is found through its last word when scanning backwards
+            for (uint32_t i = first; offset && (i < END) && ((i - first) < EMU_EEPROM_INDEX_SIZE); i++)
+            {
+                _offsetIndex[i & (EMU_EEPROM_INDEX_SIZE - 1)] = (offset + TOMBSTONE_SIZE - 4) / 4;
+            }
+        }
+        else
+        {
+            for (uint32_t i = first; i < END; i++)
+            {
+                setCache(i, 0xFFFF);
+                setDirty(i, false);
+            }
+
+            for (auto& record : _bitRecords)
+            {
+                if ((record.address >= first) && (record.address < END))
+                {
+                    record = BitRecord();
+                }
+            }
+        }
+    }
+
+    /// Increments the variable by one, treating missing one as zero.
+    /// Increments are done by clearing bits in place, so that a new record is needed only once in a while.
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::increment(uint32_t address)
+    {
+        TraceScope scope(*this, traceOp_t::INCREMENT, address);
+
+        if (address >= maxAddress())
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        // bits cleared in place on the old page wouldn't show up on the new one
+        if (auto status = completeCopy(); status != writeStatus_t::OK)
+        {
+            return status;
+        }
+
+        uint16_t value = cacheValue(address);
+        value          = value == 0xFFFF ? 1 : value + 1;
+
+        // 0xFFFF can't be stored
+        if (value == 0xFFFF)
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        if (auto record = findBitRecord(address); (record != nullptr) && record->counter && updateBitRecord(*record, value))
+        {
+            return writeStatus_t::OK;
+        }
+
+        return writeBitRecord(address, value, true);
+    }
+
+    /// Clears bits set in mask, treating missing variable as one with all bits set.
+    /// Bits are cleared in place, so that a new record is needed only once per page transfer.
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::clearFlags(uint32_t address, uint16_t mask)
+    {
+        TraceScope scope(*this, traceOp_t::CLEAR_FLAGS, address, mask);
+
+        if (address >= maxAddress())
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        // bits cleared in place on the old page wouldn't show up on the new one
+        if (auto status = completeCopy(); status != writeStatus_t::OK)
+        {
+            return status;
+        }
+
+        const uint16_t CURRENT = cacheValue(address);
+        const uint16_t VALUE   = CURRENT & ~mask;
+
+        if (VALUE == CURRENT)
+        {
+            return writeStatus_t::OK;
+        }
+
+        if (auto record = findBitRecord(address); (record != nullptr) && !record->counter && updateBitRecord(*record, VALUE))
+        {
+            return writeStatus_t::OK;
+        }
+
+        return writeBitRecord(address, VALUE, false);
+    }
+
+    /// Writes new counter or flags record.
+    /// Falls back to plain record when there is no space left to track it, when the record doesn't fit
+    /// even after page transfer, for addresses wider than 16 bits and with bounded cache,
+    /// which can't look up such records.
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::writeBitRecord(uint32_t address, uint16_t value, bool counter)
+    {
+        RetainedGuard guard(*this);
+
+        if (BOUNDED_CACHE || (address >= 0xFFFF) || ((findBitRecord(address) == nullptr) && (findBitRecord(0xFFFF) == nullptr)))
+        {
+            return writeWithTransfer(address, value, false);
+        }
+
+        const uint32_t SIZE = counter ? (2 + COUNTER_WORDS) * 4 : 8;
+        page_t         validPage;
+        uint32_t       offset;
+        auto           status = allocate(SIZE, false, validPage, offset);
+
+        if (status == writeStatus_t::PAGE_FULL)
+        {
+            status = pageTransfer();
+
+            if (status == writeStatus_t::OK)
+            {
+                status = allocate(SIZE, false, validPage, offset);
+
+                // plain record takes less space
+                if (status == writeStatus_t::PAGE_FULL)
+                {
+                    return writeInternal(address, value, false);
+                }
+            }
+        }
+
+        if (status != writeStatus_t::OK)
+        {
+            return status;
+        }
+
+        if (!program(validPage, offset, EXTENDED_MARKER | (counter ? COUNTER_RECORD : FLAGS_RECORD)))
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        // once the marker is in place, the entire record is used up even if writing the rest fails
+        _nextOffsetToWrite = offset + SIZE;
+
+        if (!program(validPage, offset + 4, address << 16 | value))
+        {
+            return writeStatus_t::WRITE_ERROR;
+        }
+
+        auto record     = addBitRecord(address);
+        record->offset  = offset;
+        record->counter = counter;
+
+        if constexpr (!BOUNDED_CACHE)
+        {
+            setCache(address, value);
+            setDirty(address, false);
+        }
+
+        return writeStatus_t::OK;
+    }
+
+    /// Updates counter or flags record in place.
+    /// Returns false if that's not possible: counter has no bits left or flash rejected the write.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::updateBitRecord(BitRecord& record, uint16_t value)
+    {
+        RetainedGuard guard(*this);
+        page_t        validPage;
+
+        // record updated in place might be the last one in page
+        _restamp = true;
+
+        if (!findValidPage(pageOp_t::WRITE, validPage))
+        {
+            return false;
+        }
+
+        bool written = false;
+
+        if (record.counter)
+        {
+            // next bit is cleared in the first word which still has any left
+            for (uint32_t i = 0; i < COUNTER_WORDS; i++)
+            {
+                const uint32_t OFFSET = record.offset + 8 + (i * 4);
+                uint32_t       bits;
+
+                if (!_hwa.read32(validPage, OFFSET, bits))
+                {
+                    return false;
+                }
+
+                if (bits)
+                {
+                    written = program(validPage, OFFSET, bits << 1);
+                    break;
+                }
+            }
+        }
+        else
+        {
+            written = program(validPage, record.offset + 4, static_cast<uint32_t>(record.address) << 16 | value);
+        }
+
+        if (!written)
+        {
+            // counter is used up or flash doesn't allow clearing more bits in already written word
+            record = BitRecord();
+            return false;
+        }
+
+        if constexpr (!BOUNDED_CACHE)
+        {
+            setCache(record.address, value);
+            setDirty(record.address, false);
+        }
+
+        return true;
+    }
+
+    template<typename HwaImpl>
+    typename BasicEmuEEPROM<HwaImpl>::BitRecord* BasicEmuEEPROM<HwaImpl>::findBitRecord(uint32_t address)
+    {
+        for (auto& record : _bitRecords)
+        {
+            if (record.address == address)
+            {
+                return &record;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /// Returns existing entry for the address or takes a free one.
+    template<typename HwaImpl>
+    typename BasicEmuEEPROM<HwaImpl>::BitRecord* BasicEmuEEPROM<HwaImpl>::addBitRecord(uint32_t address)
+    {
+        auto record = findBitRecord(address);
+
+        if (record == nullptr)
+        {
+            record = findBitRecord(0xFFFF);
+        }
+
+        if (record != nullptr)
+        {
+            record->address = address;
+        }
+
+        return record;
+    }
+
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::setTrace(Trace* trace)
+    {
+        _trace = trace;
+    }
+
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::trace(traceOp_t op, uint32_t address, uint32_t data)
+    {
+        if (_trace != nullptr)
+        {
+            TraceEvent event;
+
+            event.op      = op;
+            event.address = address;
+            event.data    = data;
+
+            _trace->record(event);
+        }
+    }
+
+    /// Returns how much of the page being written to is used up, in percent.
+    /// End of written data which isn't known yet (right after format) counts as empty page.
+    template<typename HwaImpl>
+    uint8_t BasicEmuEEPROM<HwaImpl>::fillLevel()
+    {
+        page_t page;
+
+        if (!findValidPage(pageOp_t::WRITE, page))
+        {
+            return 100;
+        }
+
+        return static_cast<uint64_t>(_nextOffsetToWrite) * 100 / pageSize(page);
+    }
+
+    template<typename HwaImpl>
+    compaction_t BasicEmuEEPROM<HwaImpl>::compactionState() const
+    {
+        if (_erase.active)
+        {
+            return compaction_t::ERASING;
+        }
+
+        return _compaction.active ? compaction_t::COPYING : compaction_t::IDLE;
+    }
+
+    /// Does a single step of page transfer ahead of time, so that it isn't done all at once by
+    /// the write which finds the page full: starts the transfer and copies variables to the new page
+    /// (programming at most given amount of words, which is decreased by the amount actually programmed),
+    /// or erases a single sector of the old page once everything is copied.
+    /// Old page remains in use until then: variables which are already copied are written to both pages.
+    /// Removals, counters and flags need the copying to be finished and do that first when used in the meantime.
+    template<typename HwaImpl>
+    writeStatus_t BasicEmuEEPROM<HwaImpl>::compact(uint32_t& words)
+    {
+        TraceScope    scope(*this, traceOp_t::COMPACT, 0, words);
+        RetainedGuard guard(*this);
+
+        if (_erase.active)
+        {
+            return serviceErase() ? writeStatus_t::OK : writeStatus_t::WRITE_ERROR;
+        }
+
+        return copyVariables(words);
+    }
+
+    /// Returns amount of flash operations done so far, including erases and page header updates
+    /// which compact() does on top of the words it's given.
+    template<typename HwaImpl>
+    FlashUsage BasicEmuEEPROM<HwaImpl>::flashUsage() const
+    {
+        return _usage;
+    }
+
+    /// Sets layout version of the variables used by the application, along with migrations from older layouts.
+    /// Has to be called before init(): variables stored in older layout are migrated in cache while the page is parsed,
+    /// and get written in the new layout only with the next page transfer. Addresses without migration keep their values.
+    /// Table has to stay valid for as long as this object is used. Not supported with bounded cache.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::defineLayout(uint16_t version, const Migration* migrations, uint32_t count)
+    {
+        if (BOUNDED_CACHE || !version || (count > EMU_EEPROM_MAX_MIGRATIONS) || (count && (migrations == nullptr)))
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (!migrations[i].version || (migrations[i].version > version))
+            {
+                return false;
+            }
+        }
+
+        _layoutVersion  = version;
+        _migrations     = migrations;
+        _migrationCount = count;
+
+        return true;
+    }
+
+    /// Returns layout version of the stored variables, or 0 if they aren't versioned.
+    template<typename HwaImpl>
+    uint16_t BasicEmuEEPROM<HwaImpl>::layoutVersion() const
+    {
+        return _cachedLayout;
+    }
+
+    /// Keeps copy of the cache in given state, which should be placed in memory retained across warm resets.
+    /// On the next init(), state is used instead of scanning the page if it's intact and still matches flash.
+    /// Should be set before init(). Not available with bounded cache.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::setRetainedState(RetainedState* state)
+    {
+        if (BOUNDED_CACHE && (state != nullptr))
+        {
+            return false;
+        }
+
+        // brought up to date with the next update
+        _retained = state;
+        _resync   = true;
+        _restamp  = true;
+
+        return true;
+    }
+
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::beginUpdate()
+    {
+        if ((_retained == nullptr) || _updateDepth++)
+        {
+            return;
+        }
+
+        _retained->busy = 1;
+
+        // state must be marked before anything else in it changes
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+
+    /// Brings retained state up to date once the outermost update is done.
+    template<typename HwaImpl>
+    void BasicEmuEEPROM<HwaImpl>::endUpdate()
+    {
+        if ((_retained == nullptr) || --_updateDepth)
+        {
+            return;
+        }
+
+        if (_resync)
+        {
+            _retained->cache = _eepromCache;
+            _retained->dirty = _dirty;
+            _retainedSum     = retainedContentSum();
+            _resync          = false;
+            _restamp         = true;
+        }
+
+        if (_restamp || (_retained->nextOffsetToWrite != _nextOffsetToWrite))
+        {
+            page_t   validPage = page_t::PAGE_1;
+            uint32_t lastWord  = 0xFFFFFFFF;
+            bool     valid     = findValidPage(pageOp_t::READ, validPage);
+
+            if (valid && (_nextOffsetToWrite > sizeof(pageStatus_t)))
+            {
+                valid = _hwa.read32(validPage, _nextOffsetToWrite - 4, lastWord);
+            }
+
+            // stamp which can't match flash if anything went wrong
+            _retained->validPage         = valid ? static_cast<uint32_t>(validPage) : 0xFFFFFFFF;
+            _retained->nextOffsetToWrite = _nextOffsetToWrite;
+            _retained->lastWord          = lastWord;
+            _retained->generation        = _generation;
+            _retained->transferOffset    = _transferOffset;
+            _retained->layout            = _cachedLayout;
+            _restamp                     = false;
+        }
+
+        _retained->magic    = RETAINED_MAGIC;
+        _retained->checksum = retainedChecksum(_retainedSum);
+
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+
+        _retained->busy = 0;
+    }
+
+    /// Takes over the cache from retained state.
+    /// Besides the checksum, only page headers, the transfer record and the words around the end of written data
+    /// are checked on flash. Page which was never transferred to is scanned for a transfer record instead.
+    template<typename HwaImpl>
+    bool BasicEmuEEPROM<HwaImpl>::restoreRetained()
+    {
+        if ((_retained == nullptr) || _retained->busy || (_retained->magic != RETAINED_MAGIC))
+        {
+            return false;
+        }
+
+        const uint32_t CONTENT_SUM = retainedContentSum();
+
+        if (retainedChecksum(CONTENT_SUM) != _retained->checksum)
+        {
+            return false;
+        }
+
+        // cache in older layout has to be migrated while parsing the page
+        if (_retained->layout < _layoutVersion)
+        {
+            return false;
+        }
+
+        page_t validPage;
+        page_t otherPage;
+
+        if (_retained->validPage == static_cast<uint32_t>(page_t::PAGE_1))
+        {
+            validPage = page_t::PAGE_1;
+            otherPage = page_t::PAGE_2;
+        }
+        else if (_retained->validPage == static_cast<uint32_t>(page_t::PAGE_2))
+        {
+            validPage = page_t::PAGE_2;
+            otherPage = page_t::PAGE_1;
+        }
+        else
+        {
+            return false;
+        }
+
+        if ((pageStatus(validPage) != pageStatus_t::VALID) || (pageStatus(otherPage) != pageStatus_t::FORMATTED))
+        {
+            return false;
+        }
+
+        const uint32_t END = _retained->nextOffsetToWrite;
+
+        if ((END < sizeof(pageStatus_t)) || (END > pageSize(validPage)) || (END % 4))
+        {
+            return false;
+        }
+
+        uint32_t word;
+
+        // nothing written since
+        if ((END < pageSize(validPage)) && (!_hwa.read32(validPage, END, word) || (word != 0xFFFFFFFF)))
+        {
+            return false;
+        }
+
+        if ((END > sizeof(pageStatus_t)) && (!_hwa.read32(validPage, END - 4, word) || (word != _retained->lastWord)))
+        {
+            return false;
+        }
+
+        // same page could have been transferred to again since, ending up with the same stamp
+        const uint32_t TRANSFER_OFFSET = _retained->transferOffset;
+        uint32_t       generation      = 0;
+
+        if (TRANSFER_OFFSET)
+        {
+            if (((TRANSFER_OFFSET + (TRANSFER_WORDS * 4)) > END) || (TRANSFER_OFFSET % 4))
+            {
+                return false;
+            }
+
+            if (!_hwa.read32(validPage, TRANSFER_OFFSET, word) || (word != (EXTENDED_MARKER | TRANSFER_RECORD)))
+            {
+                return false;
+            }
+
+            if (!_hwa.read32(validPage, TRANSFER_OFFSET + 4, generation))
+            {
+                return false;
+            }
+        }
+        else if (pageGeneration(validPage, generation))
+        {
+            return false;
+        }
+
+        if (generation != _retained->generation)
+        {
+            return false;
+        }
+
+        resetCache();
+
+        // counters and flags are no longer tracked, so they're continued in new records
+        _eepromCache       = _retained->cache;
+        _dirty             = _retained->dirty;
+        _retainedSum       = CONTENT_SUM;
+        _resync            = false;
+        _nextOffsetToWrite = END;
+        _generation        = _retained->generation;
+        _transferOffset    = TRANSFER_OFFSET;
+        _cachedLayout      = _retained->layout;
+
+        rebuildKeyIndex();
+
+        return true;
+    }
+
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::retainedContentSum() const
+    {
+        uint32_t sum = 0;
+
+        for (uint32_t i = 0; i < _retained->cache.size(); i++)
+        {
+            sum += CHECKSUM_WORD(i, _retained->cache[i]);
+        }
+
+        for (uint32_t i = 0; i < _retained->dirty.size(); i++)
+        {
+            sum += CHECKSUM_WORD(MAX_ADDRESS + i, _retained->dirty[i]);
+        }
+
+        return sum;
+    }
+
+    /// Checksum of the entire retained state: stamp and given checksum of its contents.
+    template<typename HwaImpl>
+    uint32_t BasicEmuEEPROM<HwaImpl>::retainedChecksum(uint32_t contentSum) const
+    {
+        return RETAINED_MAGIC +
+               CHECKSUM_WORD(0xFFFFFFFF, _retained->validPage) +
+               CHECKSUM_WORD(0xFFFFFFFE, _retained->nextOffsetToWrite) +
+               CHECKSUM_WORD(0xFFFFFFFD, _retained->lastWord) +
+               CHECKSUM_WORD(0xFFFFFFFC, _retained->generation) +
+               CHECKSUM_WORD(0xFFFFFFFB, _retained->layout) +
+               CHECKSUM_WORD(0xFFFFFFFA, _retained->transferOffset) +
+               contentSum;
+    }
+
+    extern template class BasicEmuEEPROM<Hwa>;
+}    // namespace lib::emueeprom
@@ -0,0 +1,82 @@
+/*
+    Copyright 2017-2022 Igor Petrovic
+
+    Permission is hereby granted, free of charge, to any person obtaining
+    a copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+    OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "emueeprom.h"
+
+#include <array>
+#include <stddef.h>
+
+namespace lib::emueeprom
+{
+    struct ImageVariable
+    {
+        uint16_t address;
+        uint16_t value;
+    };
+
+    /// Returns true if none of the variables uses address 0xFFFF (extended record marker),
+    /// address outside of the address space or blank (0xFFFF) value.
+    template<size_t SIZE>
+    constexpr bool validImageVariables(const std::array<ImageVariable, SIZE>& variables)
+    {
+        for (size_t i = 0; i < SIZE; i++)
+        {
+            if ((variables[i].address == 0xFFFF) || (variables[i].address >= EmuEEPROM::MAX_ADDRESS) || (variables[i].value == 0xFFFF))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /// Builds page image out of the list of variables, suitable for EmuEEPROM::importImage()
+    /// or for placing directly in the factory page.
+    /// Variables are passed as template argument so that they're always checked at build time,
+    /// which requires them to have static storage duration:
+    /// static constexpr std::array<ImageVariable, 2> VARIABLES = { { { 0, 0x1234 }, { 1, 0x5678 } } };
+    /// constexpr auto IMAGE = BUILD_IMAGE<VARIABLES>();
+    /// Variables are stored in order, so when address is repeated, the last value is used.
+    template<const auto& VARIABLES>
+    constexpr std::array<uint32_t, EMU_EEPROM_PAGE_SIZE / 4> BUILD_IMAGE()
+    {
+        static_assert(VARIABLES.size() < (EMU_EEPROM_PAGE_SIZE / 4), "Too many variables for a single page");
+        static_assert(validImageVariables(VARIABLES), "Invalid variable address or value");
+
+        std::array<uint32_t, EMU_EEPROM_PAGE_SIZE / 4> image = {};
+
+        for (size_t i = 0; i < image.size(); i++)
+        {
+            image[i] = 0xFFFFFFFF;
+        }
+
+        image[0] = static_cast<uint32_t>(pageStatus_t::VALID);
+
+        for (size_t i = 0; i < VARIABLES.size(); i++)
+        {
+            image[i + 1] = static_cast<uint32_t>(VARIABLES[i].address) << 16 | VARIABLES[i].value;
+        }
+
+        return image;
+    }
+}    // namespace lib::emueeprom
\ No newline at end of file
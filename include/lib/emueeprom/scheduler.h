@@ -0,0 +1,114 @@
+/*
+    Copyright 2017-2022 Igor Petrovic
+
+    Permission is hereby granted, free of charge, to any person obtaining
+    a copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+    OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "common.h"
+
+#include <array>
+
+namespace lib::emueeprom
+{
+    /// Spreads page transfers of several EmuEEPROM instances over time, so that flash operations
+    /// done by a single tick() call stay within the given budget.
+    /// Instances which filled their pages past the threshold are compacted ahead of time with compact(),
+    /// in steps small enough to fit, instead of leaving the entire transfer to the write which finds the page full.
+    /// Instances can use different flash drivers, each with its own cost of flash operations.
+    class CompactionScheduler
+    {
+        public:
+        /// Cost of flash operations, in any unit shared with the tick budget (usually microseconds).
+        struct Cost
+        {
+            uint32_t program = 0;    ///< Programming of single word
+            uint32_t erase   = 0;    ///< Erase of single sector
+        };
+
+        template<typename EmuEEPROM>
+        bool add(EmuEEPROM& emuEEPROM, Cost cost, uint8_t priority = 0, uint8_t threshold = 75);
+
+        uint8_t  count() const;
+        uint8_t  fillLevel(uint8_t index);
+        uint32_t tick(uint32_t budget);
+
+        private:
+        /// Registered instance, with its type erased.
+        struct Instance
+        {
+            void*         emuEEPROM                                    = nullptr;
+            uint8_t       (*fillLevel)(void* emuEEPROM)                = nullptr;
+            compaction_t  (*state)(void* emuEEPROM)                    = nullptr;
+            writeStatus_t (*compact)(void* emuEEPROM, uint32_t& words) = nullptr;
+            FlashUsage    (*usage)(void* emuEEPROM)                    = nullptr;
+            Cost          cost                                         = {};
+            uint8_t       priority                                     = 0;
+            uint8_t       threshold                                    = 0;    ///< Fill level in percent at which compaction starts
+        };
+
+        std::array<Instance, EMU_EEPROM_MAX_SCHEDULED> _instances = {};
+        uint8_t                                        _count     = 0;
+
+        uint32_t step(Instance& instance, uint32_t budget);
+        uint32_t spent(const Instance& instance, const FlashUsage& since) const;
+    };
+
+    /// Registers the instance. Instances with higher priority get their share of the budget first.
+    /// Budget passed to tick() should cover at least a single sector erase of each instance,
+    /// otherwise its pages are never erased ahead of time. Instances with bounded cache copy all
+    /// the variables in a single step, so it should cover that as well.
+    template<typename EmuEEPROM>
+    bool CompactionScheduler::add(EmuEEPROM& emuEEPROM, Cost cost, uint8_t priority, uint8_t threshold)
+    {
+        if (_count == _instances.size())
+        {
+            return false;
+        }
+
+        auto& instance = _instances[_count++];
+
+        instance.emuEEPROM = &emuEEPROM;
+        instance.cost      = cost;
+        instance.priority  = priority;
+        instance.threshold = threshold;
+
+        instance.fillLevel = [](void* object)
+        {
+            return static_cast<EmuEEPROM*>(object)->fillLevel();
+        };
+
+        instance.state = [](void* object)
+        {
+            return static_cast<EmuEEPROM*>(object)->compactionState();
+        };
+
+        instance.compact = [](void* object, uint32_t& words)
+        {
+            return static_cast<EmuEEPROM*>(object)->compact(words);
+        };
+
+        instance.usage = [](void* object)
+        {
+            return static_cast<EmuEEPROM*>(object)->flashUsage();
+        };
+
+        return true;
+    }
+}    // namespace lib::emueeprom
\ No newline at end of file
@@ -0,0 +1,110 @@
+/*
+    Copyright 2017-2022 Igor Petrovic
+
+    Permission is hereby granted, free of charge, to any person obtaining
+    a copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+    OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+namespace lib::emueeprom
+{
+    enum class traceOp_t : uint8_t
+    {
+        READ,
+        WRITE,
+        WRITE_CACHE_ONLY,
+        WRITE_CACHE_TO_FLASH,
+        EMERGENCY_FLUSH,
+        READ_KEY,
+        WRITE_KEY,
+        WRITE_KEY_CACHE_ONLY,
+        INCREMENT,
+        CLEAR_FLAGS,
+        REMOVE,
+        READ_RANGE,
+        INIT,
+        FORMAT,
+        FORMAT_PARTITION,
+        PAGE_TRANSFER,
+        IMPORT_IMAGE,
+        EXPORT_IMAGE,
+        COMPACT,
+        AMOUNT
+    };
+
+    struct TraceEvent
+    {
+        traceOp_t op      = traceOp_t::READ;
+        uint32_t  address = 0;    ///< Variable address, key, partition index or image size, depending on operation
+        uint32_t  data    = 0;    ///< Written value or flag mask, number of variables for range operations or word budget for compact()
+    };
+
+    /// Receives every public API call which reads or changes variables, made on EmuEEPROM instance it's attached to.
+    /// Calls the instance makes on its own (such as format() from init()) and configuration calls aren't included.
+    /// Image contents aren't included either, only the size.
+    class Trace
+    {
+        public:
+        virtual void record(const TraceEvent& event) = 0;
+    };
+
+    /// Encodes trace events into caller-provided buffer.
+    /// Each event takes one byte for operation, variable-length address (1-5 bytes) for operations which have one,
+    /// two bytes of data for written values and masks, or variable-length count (1-5 bytes) for range operations.
+    class TraceRecorder : public Trace
+    {
+        public:
+        TraceRecorder(uint8_t* buffer, size_t size)
+            : _buffer(buffer)
+            , _capacity(size)
+        {}
+
+        void   record(const TraceEvent& event) override;
+        size_t size() const;
+        bool   overflow() const;
+        void   reset();
+
+        private:
+        uint8_t* _buffer;
+        size_t   _capacity;
+        size_t   _size     = 0;
+        bool     _overflow = false;
+    };
+
+    /// Decodes events encoded with TraceRecorder.
+    class TraceReader
+    {
+        public:
+        TraceReader(const uint8_t* buffer, size_t size)
+            : _buffer(buffer)
+            , _size(size)
+        {}
+
+        bool next(TraceEvent& event);
+
+        private:
+        bool decodeVarint(uint32_t& value);
+
+        const uint8_t* _buffer;
+        size_t         _size;
+        size_t         _offset = 0;
+    };
+}    // namespace lib::emueeprom
\ No newline at end of file
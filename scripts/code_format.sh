@@ -4,7 +4,7 @@ script_dir=$(cd -- "$(dirname -- "${BASH_SOURCE[0]}")" &> /dev/null && pwd)
 project_dir=$(realpath "${script_dir}"/..)
 
 find "$project_dir" \
--regex '.*\.\(cpp\|hpp\|h\|cc\|cxx\|c\)' \
+-regex '.*\.\(cpp\|hpp\|h\|tpp\|cc\|cxx\|c\)' \
 -not -path '**build/**/*' \
 -not -path '**generated/**/*' \
 -not -path '**modules/**/*' \
@@ -0,0 +1,165 @@
+/*
+    Copyright 2017-2022 Igor Petrovic
+
+    Permission is hereby granted, free of charge, to any person obtaining
+    a copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+    OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "lib/emueeprom/scheduler.h"
+
+#include <algorithm>
+
+using namespace lib::emueeprom;
+
+uint8_t CompactionScheduler::count() const
+{
+    return _count;
+}
+
+/// Returns how much of the page being written to is used up by the instance, in percent.
+uint8_t CompactionScheduler::fillLevel(uint8_t index)
+{
+    if (index >= _count)
+    {
+        return 0;
+    }
+
+    return _instances[index].fillLevel(_instances[index].emuEEPROM);
+}
+
+/// Continues page transfers in progress and starts new ones where needed, as long as the budget allows.
+/// Steps are started only if their worst case fits into what is left, so the cost stays within the budget
+/// unless flash rejects a sector erase, in which case the entire page is erased at once.
+/// Returns the cost of flash operations actually done.
+uint32_t CompactionScheduler::tick(uint32_t budget)
+{
+    std::array<uint8_t, EMU_EEPROM_MAX_SCHEDULED>      order;
+    std::array<uint8_t, EMU_EEPROM_MAX_SCHEDULED>      fill;
+    std::array<compaction_t, EMU_EEPROM_MAX_SCHEDULED> state;
+
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        order[i] = i;
+        fill[i]  = _instances[i].fillLevel(_instances[i].emuEEPROM);
+        state[i] = _instances[i].state(_instances[i].emuEEPROM);
+    }
+
+    // higher priority first, then transfers already in progress, then the fullest pages
+    auto compare = [this, &fill, &state](uint8_t a, uint8_t b)
+    {
+        if (_instances[a].priority != _instances[b].priority)
+        {
+            return _instances[a].priority > _instances[b].priority;
+        }
+
+        if ((state[a] == compaction_t::IDLE) != (state[b] == compaction_t::IDLE))
+        {
+            return state[a] != compaction_t::IDLE;
+        }
+
+        return fill[a] > fill[b];
+    };
+
+    std::sort(order.begin(), order.begin() + _count, compare);
+
+    uint32_t spent = 0;
+
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        const uint8_t INDEX = order[i];
+
+        if ((state[INDEX] == compaction_t::IDLE) && (fill[INDEX] < _instances[INDEX].threshold))
+        {
+            continue;
+        }
+
+        if (spent >= budget)
+        {
+            break;
+        }
+
+        spent += step(_instances[INDEX], budget - spent);
+    }
+
+    return spent;
+}
+
+/// Runs as many compaction steps of the instance as the budget allows, up to the end of its page transfer.
+/// Returns their cost, which includes every program and erase they did, even those beyond the given words.
+uint32_t CompactionScheduler::step(Instance& instance, uint32_t budget)
+{
+    const auto START = instance.usage(instance.emuEEPROM);
+
+    for (bool first = true;; first = false)
+    {
+        const auto     STATE = instance.state(instance.emuEEPROM);
+        const uint32_t SPENT = spent(instance, START);
+
+        if (SPENT >= budget)
+        {
+            break;
+        }
+
+        if (STATE == compaction_t::ERASING)
+        {
+            // last sector is followed by programming of both page headers
+            const uint32_t COST  = instance.cost.erase + (2 * instance.cost.program);
+            uint32_t       words = 0;
+
+            if (COST > (budget - SPENT))
+            {
+                break;
+            }
+
+            instance.compact(instance.emuEEPROM, words);
+
+            // next sector can't be started before this one is done anyway with pages in separate banks,
+            // and polling the bank until then is covered by the erase cost
+            return std::max(spent(instance, START), SPENT + COST);
+        }
+
+        // new transfer isn't started once the previous one is done
+        if ((STATE == compaction_t::IDLE) && !first)
+        {
+            break;
+        }
+
+        const uint32_t WORDS = instance.cost.program ? (budget - SPENT) / instance.cost.program : UINT32_MAX;
+        uint32_t       words = WORDS;
+
+        if (!WORDS || (instance.compact(instance.emuEEPROM, words) != writeStatus_t::OK))
+        {
+            break;
+        }
+
+        // not enough budget left for the next record
+        if (words == WORDS)
+        {
+            break;
+        }
+    }
+
+    return spent(instance, START);
+}
+
+/// Returns cost of the flash operations the instance did since given usage.
+uint32_t CompactionScheduler::spent(const Instance& instance, const FlashUsage& since) const
+{
+    const auto USAGE = instance.usage(instance.emuEEPROM);
+
+    return ((USAGE.programmed - since.programmed) * instance.cost.program) + ((USAGE.erased - since.erased) * instance.cost.erase);
+}
\ No newline at end of file
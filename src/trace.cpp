@@ -0,0 +1,198 @@
+/*
+    Copyright 2017-2022 Igor Petrovic
+
+    Permission is hereby granted, free of charge, to any person obtaining
+    a copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+    OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "lib/emueeprom/trace.h"
+
+using namespace lib::emueeprom;
+
+namespace
+{
+    bool hasData(traceOp_t op)
+    {
+        switch (op)
+        {
+        case traceOp_t::WRITE:
+        case traceOp_t::WRITE_CACHE_ONLY:
+        case traceOp_t::WRITE_KEY:
+        case traceOp_t::WRITE_KEY_CACHE_ONLY:
+        case traceOp_t::CLEAR_FLAGS:
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    bool hasCount(traceOp_t op)
+    {
+        return (op == traceOp_t::REMOVE) || (op == traceOp_t::READ_RANGE) || (op == traceOp_t::COMPACT);
+    }
+
+    bool hasAddress(traceOp_t op)
+    {
+        switch (op)
+        {
+        case traceOp_t::WRITE_CACHE_TO_FLASH:
+        case traceOp_t::EMERGENCY_FLUSH:
+        case traceOp_t::INIT:
+        case traceOp_t::FORMAT:
+        case traceOp_t::PAGE_TRANSFER:
+        case traceOp_t::EXPORT_IMAGE:
+        case traceOp_t::COMPACT:
+            return false;
+
+        default:
+            return true;
+        }
+    }
+
+    /// 7 bits per byte, highest bit set if more bytes follow.
+    size_t encodeVarint(uint32_t value, uint8_t* encoded)
+    {
+        size_t size = 0;
+
+        do
+        {
+            encoded[size] = value & 0x7F;
+            value >>= 7;
+
+            if (value)
+            {
+                encoded[size] |= 0x80;
+            }
+
+            size++;
+        } while (value);
+
+        return size;
+    }
+}    // namespace
+
+void TraceRecorder::record(const TraceEvent& event)
+{
+    uint8_t encoded[11];
+    size_t  size = 0;
+
+    encoded[size++] = static_cast<uint8_t>(event.op);
+
+    if (hasAddress(event.op))
+    {
+        size += encodeVarint(event.address, &encoded[size]);
+    }
+
+    if (hasData(event.op))
+    {
+        encoded[size++] = event.data & 0xFF;
+        encoded[size++] = (event.data >> 8) & 0xFF;
+    }
+    else if (hasCount(event.op))
+    {
+        size += encodeVarint(event.data, &encoded[size]);
+    }
+
+    // events are never stored partially
+    if ((_capacity - _size) < size)
+    {
+        _overflow = true;
+        return;
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        _buffer[_size++] = encoded[i];
+    }
+}
+
+size_t TraceRecorder::size() const
+{
+    return _size;
+}
+
+bool TraceRecorder::overflow() const
+{
+    return _overflow;
+}
+
+void TraceRecorder::reset()
+{
+    _size     = 0;
+    _overflow = false;
+}
+
+bool TraceReader::next(TraceEvent& event)
+{
+    if (_offset >= _size)
+    {
+        return false;
+    }
+
+    if (_buffer[_offset] >= static_cast<uint8_t>(traceOp_t::AMOUNT))
+    {
+        return false;
+    }
+
+    event.op      = static_cast<traceOp_t>(_buffer[_offset++]);
+    event.address = 0;
+    event.data    = 0;
+
+    if (hasAddress(event.op) && !decodeVarint(event.address))
+    {
+        return false;
+    }
+
+    if (hasData(event.op))
+    {
+        if ((_size - _offset) < 2)
+        {
+            return false;
+        }
+
+        event.data = _buffer[_offset] | (_buffer[_offset + 1] << 8);
+        _offset += 2;
+    }
+    else if (hasCount(event.op) && !decodeVarint(event.data))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool TraceReader::decodeVarint(uint32_t& value)
+{
+    value = 0;
+
+    for (uint8_t shift = 0;; shift += 7)
+    {
+        if ((_offset >= _size) || (shift > 28))
+        {
+            return false;
+        }
+
+        uint8_t byte = _buffer[_offset++];
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+}
\ No newline at end of file
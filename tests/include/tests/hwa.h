@@ -0,0 +1,371 @@
+#pragma once
+
+#include "lib/emueeprom/common.h"
+
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace tests
+{
+    using namespace lib::emueeprom;
+
+    /// Flash simulated in RAM with the same programming rules as real flash (only 1->0 transitions).
+    /// Counts all flash operations so that tests can measure their cost.
+    class HwaTest final : public Hwa
+    {
+        public:
+        HwaTest() = default;
+
+        bool init() override
+        {
+            return true;
+        }
+
+        bool erasePage(page_t page) override
+        {
+            if (page == page_t::PAGE_FACTORY)
+            {
+                return false;
+            }
+
+            std::fill(_pageArray.at(static_cast<uint8_t>(page)).begin(), _pageArray.at(static_cast<uint8_t>(page)).end(), 0xFF);
+            _pageEraseCounter++;
+
+            return true;
+        }
+
+        bool write32(page_t page, uint32_t offset, uint32_t data) override
+        {
+            if (page == page_t::PAGE_FACTORY)
+            {
+                return false;
+            }
+
+            _writeCounter++;
+
+            if ((offset == 0) && (data == static_cast<uint32_t>(pageStatus_t::RECEIVING)))
+            {
+                _transferCounter++;
+            }
+
+            // 0->1 transition is not allowed
+            uint32_t currentData = 0;
+            read32(page, offset, currentData);
+
+            if (data > currentData)
+            {
+                return false;
+            }
+
+            _pageArray.at(static_cast<uint8_t>(page)).at(offset + 0) = (data >> 0) & static_cast<uint16_t>(0xFF);
+            _pageArray.at(static_cast<uint8_t>(page)).at(offset + 1) = (data >> 8) & static_cast<uint16_t>(0xFF);
+            _pageArray.at(static_cast<uint8_t>(page)).at(offset + 2) = (data >> 16) & static_cast<uint16_t>(0xFF);
+            _pageArray.at(static_cast<uint8_t>(page)).at(offset + 3) = (data >> 24) & static_cast<uint16_t>(0xFF);
+
+            return true;
+        }
+
+        bool read32(page_t page, uint32_t offset, uint32_t& data) override
+        {
+            _readCounter++;
+
+            data = _pageArray.at(static_cast<uint8_t>(page)).at(offset + 3);
+            data <<= 8;
+            data |= _pageArray.at(static_cast<uint8_t>(page)).at(offset + 2);
+            data <<= 8;
+            data |= _pageArray.at(static_cast<uint8_t>(page)).at(offset + 1);
+            data <<= 8;
+            data |= _pageArray.at(static_cast<uint8_t>(page)).at(offset + 0);
+
+            return true;
+        }
+
+        const uint32_t* pageAddress(page_t page) override
+        {
+            if (!_mapped || (page == page_t::PAGE_FACTORY))
+            {
+                return nullptr;
+            }
+
+            return reinterpret_cast<const uint32_t*>(_pageArray.at(static_cast<uint8_t>(page)).data());
+        }
+
+        alignas(4) std::array<std::array<uint8_t, EMU_EEPROM_PAGE_SIZE>, 2> _pageArray;
+        size_t                                                              _pageEraseCounter = 0;
+        size_t                                                              _readCounter      = 0;
+        size_t                                                              _writeCounter     = 0;
+        size_t                                                              _transferCounter  = 0;
+        bool                                                                _mapped           = false;
+    };
+
+    /// Flash simulated in RAM with pages of different sizes, each made of several equally sized sectors.
+    /// Whole pages can't be erased at once: only sector erase is supported.
+    class HwaSectorTest final : public Hwa
+    {
+        public:
+        HwaSectorTest(uint32_t sectorSize, uint32_t page1Sectors, uint32_t page2Sectors)
+            : _sectorSize(sectorSize)
+            , _sectorCount({ page1Sectors, page2Sectors })
+        {
+            for (size_t i = 0; i < _pages.size(); i++)
+            {
+                _pages.at(i).resize(_sectorSize * _sectorCount.at(i) / 4, 0xFFFFFFFF);
+            }
+        }
+
+        bool init() override
+        {
+            return true;
+        }
+
+        bool erasePage(page_t) override
+        {
+            return false;
+        }
+
+        bool write32(page_t page, uint32_t offset, uint32_t data) override
+        {
+            if (page == page_t::PAGE_FACTORY)
+            {
+                return false;
+            }
+
+            auto& word = _pages.at(static_cast<uint8_t>(page)).at(offset / 4);
+
+            // 0->1 transition is not allowed
+            if (data > word)
+            {
+                return false;
+            }
+
+            word = data;
+            return true;
+        }
+
+        bool read32(page_t page, uint32_t offset, uint32_t& data) override
+        {
+            if (page == page_t::PAGE_FACTORY)
+            {
+                return false;
+            }
+
+            data = _pages.at(static_cast<uint8_t>(page)).at(offset / 4);
+            return true;
+        }
+
+        uint32_t pageSize(page_t page) override
+        {
+            return page == page_t::PAGE_FACTORY ? 0 : _sectorSize * _sectorCount.at(static_cast<uint8_t>(page));
+        }
+
+        uint32_t sectorCount(page_t page) override
+        {
+            return page == page_t::PAGE_FACTORY ? 0 : _sectorCount.at(static_cast<uint8_t>(page));
+        }
+
+        bool eraseSector(page_t page, uint32_t sector) override
+        {
+            if ((page == page_t::PAGE_FACTORY) || (sector >= _sectorCount.at(static_cast<uint8_t>(page))))
+            {
+                return false;
+            }
+
+            auto begin = _pages.at(static_cast<uint8_t>(page)).begin() + (sector * _sectorSize / 4);
+            std::fill(begin, begin + (_sectorSize / 4), 0xFFFFFFFF);
+            _sectorEraseCounter.at(static_cast<uint8_t>(page))++;
+
+            return true;
+        }
+
+        uint32_t                             _sectorSize;
+        std::array<uint32_t, 2>              _sectorCount;
+        std::array<std::vector<uint32_t>, 2> _pages              = {};
+        std::array<size_t, 2>                _sectorEraseCounter = {};
+    };
+
+    /// Duration of simulated flash operations, in arbitrary units of virtual time.
+    struct FlashTiming
+    {
+        uint32_t programTime = 10;      ///< Programming of single word
+        uint32_t eraseTime   = 1000;    ///< Erase of entire page
+        uint32_t readTime    = 1;       ///< Reading of single word
+        uint32_t pollTime    = 1;       ///< Checking whether the bank is busy
+    };
+
+    /// Flash simulated in RAM with a virtual clock advanced by each operation according to the timing model.
+    /// Each page can be placed in its own bank: access to a bank waits for the erase started on it to finish,
+    /// while the other bank stays available.
+    /// Power can be cut after given amount of programming and erase operations: any erase still in progress
+    /// at that moment is left half done, and all following flash operations fail until power is restored.
+    class HwaTimedTest final : public Hwa
+    {
+        public:
+        HwaTimedTest(uint32_t pageSize, FlashTiming timing = {}, bool dualBank = false)
+            : _timing(timing)
+            , _dualBank(dualBank)
+        {
+            for (auto& page : _pages)
+            {
+                page.resize(pageSize / 4, 0xFFFFFFFF);
+            }
+        }
+
+        bool init() override
+        {
+            return true;
+        }
+
+        bool erasePage(page_t page) override
+        {
+            if (!startEraseSector(page, 0))
+            {
+                return false;
+            }
+
+            // power can also be lost while waiting for the erase to finish
+            if (!powered())
+            {
+                return false;
+            }
+
+            wait(page);
+            return true;
+        }
+
+        bool write32(page_t page, uint32_t offset, uint32_t data) override
+        {
+            if ((page == page_t::PAGE_FACTORY) || !powered())
+            {
+                return false;
+            }
+
+            wait(page);
+            _time += _timing.programTime;
+            _writeCounter++;
+
+            auto& word = _pages.at(static_cast<uint8_t>(page)).at(offset / 4);
+
+            // 0->1 transition is not allowed
+            if (data > word)
+            {
+                return false;
+            }
+
+            word = data;
+            return true;
+        }
+
+        bool read32(page_t page, uint32_t offset, uint32_t& data) override
+        {
+            if ((page == page_t::PAGE_FACTORY) || _powerLost)
+            {
+                return false;
+            }
+
+            wait(page);
+            _time += _timing.readTime;
+            _readCounter++;
+
+            data = _pages.at(static_cast<uint8_t>(page)).at(offset / 4);
+            return true;
+        }
+
+        uint32_t pageSize(page_t page) override
+        {
+            return page == page_t::PAGE_FACTORY ? 0 : _pages.at(static_cast<uint8_t>(page)).size() * 4;
+        }
+
+        uint8_t bank(page_t page) override
+        {
+            return _dualBank ? static_cast<uint8_t>(page) : 0;
+        }
+
+        bool startEraseSector(page_t page, uint32_t sector) override
+        {
+            if ((page == page_t::PAGE_FACTORY) || sector || !powered())
+            {
+                return false;
+            }
+
+            wait(page);
+            _eraseCounter++;
+
+            // old contents are kept around in case the erase gets interrupted
+            auto& words = _pages.at(static_cast<uint8_t>(page));
+            _erased.at(static_cast<uint8_t>(page)) = words;
+            std::fill(words.begin(), words.end(), 0xFFFFFFFF);
+
+            _busyUntil.at(bank(page))                = _time + _timing.eraseTime;
+            _eraseEnd.at(static_cast<uint8_t>(page)) = _busyUntil.at(bank(page));
+
+            return true;
+        }
+
+        bool busy(page_t page) override
+        {
+            _time += _timing.pollTime;
+            return _time < _busyUntil.at(bank(page));
+        }
+
+        void wait(page_t page)
+        {
+            _time = std::max(_time, _busyUntil.at(bank(page)));
+        }
+
+        /// Cuts the power once the given amount of programming and erase operations has been started.
+        void cutPowerAfter(size_t operations)
+        {
+            _powerBudget = operations;
+        }
+
+        /// Powers the flash back on. Erase interrupted by the power cut doesn't resume.
+        void restorePower()
+        {
+            _powerLost   = false;
+            _powerBudget = SIZE_MAX;
+            _busyUntil.fill(_time);
+            _eraseEnd.fill(_time);
+        }
+
+        bool powered()
+        {
+            if (!_powerLost && !_powerBudget)
+            {
+                _powerLost = true;
+
+                // erase in progress is left half done: header is already gone, the rest isn't
+                for (size_t i = 0; i < _pages.size(); i++)
+                {
+                    if (_time < _eraseEnd.at(i))
+                    {
+                        const size_t HALF = _pages.at(i).size() / 2;
+                        std::copy(_erased.at(i).begin() + HALF, _erased.at(i).end(), _pages.at(i).begin() + HALF);
+                    }
+                }
+            }
+
+            if (_powerLost)
+            {
+                return false;
+            }
+
+            _powerBudget--;
+            return true;
+        }
+
+        FlashTiming                          _timing;
+        bool                                 _dualBank;
+        std::array<std::vector<uint32_t>, 2> _pages        = {};
+        std::array<std::vector<uint32_t>, 2> _erased       = {};
+        std::array<uint64_t, 2>              _busyUntil    = {};
+        std::array<uint64_t, 2>              _eraseEnd     = {};
+        uint64_t                             _time         = 0;
+        size_t                               _readCounter  = 0;
+        size_t                               _writeCounter = 0;
+        size_t                               _eraseCounter = 0;
+        size_t                               _powerBudget  = SIZE_MAX;
+        bool                                 _powerLost    = false;
+    };
+}    // namespace tests
\ No newline at end of file
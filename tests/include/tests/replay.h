@@ -0,0 +1,416 @@
+#pragma once
+
+#include "tests/hwa.h"
+#include "lib/emueeprom/trace.h"
+
+#include <chrono>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <memory>
+#include <string>
+#include <iostream>
+
+namespace tests
+{
+    /// Virtual time taken by calls of single API operation.
+    struct LatencyStats
+    {
+        size_t   calls = 0;
+        uint64_t p50   = 0;
+        uint64_t p99   = 0;
+        uint64_t max   = 0;
+    };
+
+    using LatencyReport = std::array<LatencyStats, static_cast<size_t>(traceOp_t::AMOUNT)>;
+
+    struct ReplayStats
+    {
+        size_t                   calls              = 0;
+        size_t                   reads              = 0;
+        size_t                   writes             = 0;
+        size_t                   erases             = 0;
+        size_t                   transfers          = 0;
+        size_t                   maxFlashOpsPerCall = 0;
+        std::chrono::nanoseconds totalTime          = {};
+        std::chrono::nanoseconds maxCallTime        = {};
+    };
+
+    /// Makes the API call described by trace event.
+    template<typename EmuEEPROM>
+    void replayEvent(EmuEEPROM& emuEEPROM, const TraceEvent& event)
+    {
+        uint16_t value;
+
+        switch (event.op)
+        {
+        case traceOp_t::READ:
+        {
+            emuEEPROM.read(event.address, value);
+        }
+        break;
+
+        case traceOp_t::WRITE:
+        case traceOp_t::WRITE_CACHE_ONLY:
+        {
+            emuEEPROM.write(event.address, event.data, event.op == traceOp_t::WRITE_CACHE_ONLY);
+        }
+        break;
+
+        case traceOp_t::WRITE_CACHE_TO_FLASH:
+        {
+            emuEEPROM.writeCacheToFlash();
+        }
+        break;
+
+        case traceOp_t::EMERGENCY_FLUSH:
+        {
+            emuEEPROM.emergencyFlush();
+        }
+        break;
+
+        case traceOp_t::READ_KEY:
+        {
+            emuEEPROM.readKey(event.address, value);
+        }
+        break;
+
+        case traceOp_t::WRITE_KEY:
+        case traceOp_t::WRITE_KEY_CACHE_ONLY:
+        {
+            emuEEPROM.writeKey(event.address, event.data, event.op == traceOp_t::WRITE_KEY_CACHE_ONLY);
+        }
+        break;
+
+        case traceOp_t::INCREMENT:
+        {
+            emuEEPROM.increment(event.address);
+        }
+        break;
+
+        case traceOp_t::CLEAR_FLAGS:
+        {
+            emuEEPROM.clearFlags(event.address, event.data);
+        }
+        break;
+
+        case traceOp_t::REMOVE:
+        {
+            emuEEPROM.removeRange(event.address, event.data);
+        }
+        break;
+
+        case traceOp_t::READ_RANGE:
+        {
+            std::vector<uint16_t> values(event.data);
+            uint32_t              present;
+
+            emuEEPROM.read(event.address, values.data(), event.data, present);
+        }
+        break;
+
+        case traceOp_t::INIT:
+        {
+            emuEEPROM.init();
+        }
+        break;
+
+        case traceOp_t::FORMAT:
+        {
+            emuEEPROM.format();
+        }
+        break;
+
+        case traceOp_t::FORMAT_PARTITION:
+        {
+            emuEEPROM.partition(static_cast<uint8_t>(event.address)).format();
+        }
+        break;
+
+        case traceOp_t::PAGE_TRANSFER:
+        {
+            emuEEPROM.pageTransfer();
+        }
+        break;
+
+        case traceOp_t::IMPORT_IMAGE:
+        {
+            // image contents aren't traced: pages are formatted instead, at the same erase cost
+            emuEEPROM.format();
+        }
+        break;
+
+        case traceOp_t::EXPORT_IMAGE:
+        {
+            auto image = std::make_unique<typename EmuEEPROM::image_t>();
+            emuEEPROM.exportImage(*image);
+        }
+        break;
+
+        case traceOp_t::COMPACT:
+        {
+            uint32_t words = event.data;
+            emuEEPROM.compact(words);
+        }
+        break;
+
+        default:
+            break;
+        }
+    }
+
+    /// Runs trace recorded with TraceRecorder against EmuEEPROM instance backed by simulated flash
+    /// and reports flash operations, page transfers and per-call latency.
+    /// Instance should be initialized and configured (flush reserve, keys, partitions...) before replaying.
+    /// Any simulated flash counting its operations like HwaTest does can be used, so the same trace
+    /// can be compared across differently configured drivers.
+    template<typename EmuEEPROM, typename HwaImpl>
+    ReplayStats replay(EmuEEPROM& emuEEPROM, HwaImpl& hwa, const uint8_t* trace, size_t size)
+    {
+        ReplayStats stats;
+        TraceReader reader(trace, size);
+        TraceEvent  event;
+
+        const size_t READS     = hwa._readCounter;
+        const size_t WRITES    = hwa._writeCounter;
+        const size_t ERASES    = hwa._pageEraseCounter;
+        const size_t TRANSFERS = hwa._transferCounter;
+
+        while (reader.next(event))
+        {
+            const size_t OPS   = hwa._readCounter + hwa._writeCounter + hwa._pageEraseCounter;
+            const auto   START = std::chrono::steady_clock::now();
+
+            replayEvent(emuEEPROM, event);
+
+            const auto TIME = std::chrono::steady_clock::now() - START;
+
+            stats.calls++;
+            stats.totalTime += TIME;
+            stats.maxCallTime        = std::max<std::chrono::nanoseconds>(stats.maxCallTime, TIME);
+            stats.maxFlashOpsPerCall = std::max(stats.maxFlashOpsPerCall, hwa._readCounter + hwa._writeCounter + hwa._pageEraseCounter - OPS);
+        }
+
+        stats.reads     = hwa._readCounter - READS;
+        stats.writes    = hwa._writeCounter - WRITES;
+        stats.erases    = hwa._pageEraseCounter - ERASES;
+        stats.transfers = hwa._transferCounter - TRANSFERS;
+
+        return stats;
+    }
+
+    /// Runs trace against EmuEEPROM instance backed by flash with timing model
+    /// and reports latency percentiles of each API operation.
+    template<typename EmuEEPROM, typename HwaImpl>
+    LatencyReport replayLatency(EmuEEPROM& emuEEPROM, HwaImpl& hwa, const uint8_t* trace, size_t size)
+    {
+        std::array<std::vector<uint64_t>, static_cast<size_t>(traceOp_t::AMOUNT)> samples;
+        LatencyReport                                                             report;
+        TraceReader                                                               reader(trace, size);
+        TraceEvent                                                                event;
+
+        while (reader.next(event))
+        {
+            const uint64_t START = hwa._time;
+
+            replayEvent(emuEEPROM, event);
+            samples.at(static_cast<size_t>(event.op)).push_back(hwa._time - START);
+        }
+
+        // nearest-rank percentiles
+        auto percentile = [](const std::vector<uint64_t>& sorted, size_t percent)
+        {
+            return sorted.at(((sorted.size() * percent) + 99) / 100 - 1);
+        };
+
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            auto& sorted = samples.at(i);
+
+            if (sorted.empty())
+            {
+                continue;
+            }
+
+            std::sort(sorted.begin(), sorted.end());
+
+            report.at(i).calls = sorted.size();
+            report.at(i).p50   = percentile(sorted, 50);
+            report.at(i).p99   = percentile(sorted, 99);
+            report.at(i).max   = sorted.back();
+        }
+
+        return report;
+    }
+
+    /// Prints latency of each operation used in the replayed trace.
+    inline void printLatency(const std::string& name, const LatencyReport& report)
+    {
+        static constexpr const char* OP_NAME[] = {
+            "read",
+            "write",
+            "write (cache only)",
+            "write cache to flash",
+            "emergency flush",
+            "read key",
+            "write key",
+            "write key (cache only)",
+            "increment",
+            "clear flags",
+            "remove",
+            "read range",
+            "init",
+            "format",
+            "format partition",
+            "page transfer",
+            "import image",
+            "export image",
+            "compact",
+        };
+
+        static_assert(sizeof(OP_NAME) / sizeof(OP_NAME[0]) == static_cast<size_t>(traceOp_t::AMOUNT));
+
+        for (size_t i = 0; i < report.size(); i++)
+        {
+            if (!report.at(i).calls)
+            {
+                continue;
+            }
+
+            std::cout << name << ": " << OP_NAME[i]
+                      << " calls=" << report.at(i).calls
+                      << " p50=" << report.at(i).p50
+                      << " p99=" << report.at(i).p99
+                      << " max=" << report.at(i).max
+                      << std::endl;
+        }
+    }
+
+    /// Cost and outcome of init() after power cut at a single point of the workload.
+    struct RecoveryStats
+    {
+        size_t   operation  = 0;        ///< Amount of flash programming and erase operations completed before the cut.
+        size_t   reads      = 0;
+        size_t   writes     = 0;
+        size_t   erases     = 0;
+        uint64_t time       = 0;        ///< Virtual time taken by init().
+        bool     recovered  = false;    ///< init() succeeded.
+        bool     consistent = false;    ///< Every variable holds either the value it had before the interrupted call or after it.
+    };
+
+    /// Replays the trace on fresh flash once for each flash programming and erase operation the trace causes,
+    /// cutting the power right after that operation. After each cut, new EmuEEPROM instance is initialized
+    /// on the same flash and checked against the values written by the trace.
+    /// Trace may contain only writes (not cache-only), reads and removals.
+    template<typename EmuEEPROM>
+    std::vector<RecoveryStats> replayPowerCuts(uint32_t pageSize, bool dualBank, const uint8_t* trace, size_t size)
+    {
+        std::vector<RecoveryStats> results;
+
+        for (size_t cut = 0;; cut++)
+        {
+            HwaTimedTest hwa(pageSize, {}, dualBank);
+            EmuEEPROM    emuEEPROM(hwa, false);
+            TraceReader  reader(trace, size);
+            TraceEvent   event;
+
+            // expected values before and after the call interrupted by the cut, -1 if not present
+            std::vector<int32_t> before(emuEEPROM.maxAddress(), -1);
+            std::vector<int32_t> after(emuEEPROM.maxAddress(), -1);
+
+            if (!emuEEPROM.init())
+            {
+                return results;
+            }
+
+            hwa.cutPowerAfter(cut);
+
+            while (!hwa._powerLost && reader.next(event))
+            {
+                before = after;
+
+                if (event.op == traceOp_t::WRITE)
+                {
+                    after.at(event.address) = event.data;
+                }
+                else if (event.op == traceOp_t::REMOVE)
+                {
+                    std::fill(after.begin() + event.address, after.begin() + event.address + event.data, -1);
+                }
+
+                replayEvent(emuEEPROM, event);
+            }
+
+            if (!hwa._powerLost)
+            {
+                // entire workload ran without reaching the cut
+                return results;
+            }
+
+            hwa.restorePower();
+            hwa._readCounter  = 0;
+            hwa._writeCounter = 0;
+            hwa._eraseCounter = 0;
+
+            RecoveryStats stats;
+            EmuEEPROM     recovered(hwa, false);
+            const auto    START = hwa._time;
+
+            stats.operation = cut;
+            stats.recovered = recovered.init();
+            stats.time      = hwa._time - START;
+            stats.reads     = hwa._readCounter;
+            stats.writes    = hwa._writeCounter;
+            stats.erases    = hwa._eraseCounter;
+
+            stats.consistent = stats.recovered;
+
+            for (uint32_t address = 0; stats.consistent && (address < recovered.maxAddress()); address++)
+            {
+                uint16_t      value;
+                const auto    STATUS = recovered.read(address, value);
+                const int32_t ACTUAL = STATUS == readStatus_t::OK ? value : -1;
+
+                stats.consistent = ((STATUS == readStatus_t::OK) || (STATUS == readStatus_t::NO_VAR)) &&
+                                   ((ACTUAL == before.at(address)) || (ACTUAL == after.at(address)));
+            }
+
+            results.push_back(stats);
+        }
+    }
+
+    /// Prints the worst and average cost of recovery over all power cuts.
+    inline void printRecovery(const std::string& name, const std::vector<RecoveryStats>& results)
+    {
+        RecoveryStats worst;
+        RecoveryStats total;
+        size_t        failed = 0;
+
+        for (const auto& stats : results)
+        {
+            worst.reads  = std::max(worst.reads, stats.reads);
+            worst.writes = std::max(worst.writes, stats.writes);
+            worst.erases = std::max(worst.erases, stats.erases);
+            worst.time   = std::max(worst.time, stats.time);
+            total.reads  += stats.reads;
+            total.writes += stats.writes;
+            total.erases += stats.erases;
+            total.time   += stats.time;
+
+            if (!stats.consistent)
+            {
+                failed++;
+            }
+        }
+
+        const size_t CUTS = std::max<size_t>(results.size(), 1);
+
+        std::cout << name << ": cuts=" << results.size()
+                  << " failed=" << failed
+                  << " erases avg=" << static_cast<double>(total.erases) / CUTS << " max=" << worst.erases
+                  << " reads avg=" << static_cast<double>(total.reads) / CUTS << " max=" << worst.reads
+                  << " writes avg=" << static_cast<double>(total.writes) / CUTS << " max=" << worst.writes
+                  << " time avg=" << static_cast<double>(total.time) / CUTS << " max=" << worst.time
+                  << std::endl;
+    }
+}    // namespace tests
\ No newline at end of file
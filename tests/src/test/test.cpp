@@ -1,9 +1,16 @@
 #include "tests/common.h"
+#include "tests/hwa.h"
+#include "tests/replay.h"
 #include "lib/emueeprom/emueeprom.h"
+#include "lib/emueeprom/image.h"
+#include "lib/emueeprom/scheduler.h"
 
 #include <array>
+#include <memory>
+#include <tuple>
 
 using namespace lib::emueeprom;
+using namespace tests;
 
 namespace
 {
@@ -21,69 +28,7 @@ namespace
         void TearDown()
         {}
 
-        class HwaTest : public Hwa
-        {
-            public:
-            HwaTest() = default;
-
-            bool init() override
-            {
-                return true;
-            }
-
-            bool erasePage(page_t page) override
-            {
-                if (page == page_t::PAGE_FACTORY)
-                {
-                    return false;
-                }
-
-                std::fill(_pageArray.at(static_cast<uint8_t>(page)).begin(), _pageArray.at(static_cast<uint8_t>(page)).end(), 0xFF);
-                _pageEraseCounter++;
-
-                return true;
-            }
-
-            bool write32(page_t page, uint32_t offset, uint32_t data) override
-            {
-                if (page == page_t::PAGE_FACTORY)
-                {
-                    return false;
-                }
-
-                // 0->1 transition is not allowed
-                uint32_t currentData = 0;
-                read32(page, offset, currentData);
-
-                if (data > currentData)
-                {
-                    return false;
-                }
-
-                _pageArray.at(static_cast<uint8_t>(page)).at(offset + 0) = (data >> 0) & static_cast<uint16_t>(0xFF);
-                _pageArray.at(static_cast<uint8_t>(page)).at(offset + 1) = (data >> 8) & static_cast<uint16_t>(0xFF);
-                _pageArray.at(static_cast<uint8_t>(page)).at(offset + 2) = (data >> 16) & static_cast<uint16_t>(0xFF);
-                _pageArray.at(static_cast<uint8_t>(page)).at(offset + 3) = (data >> 24) & static_cast<uint16_t>(0xFF);
-
-                return true;
-            }
-
-            bool read32(page_t page, uint32_t offset, uint32_t& data) override
-            {
-                data = _pageArray.at(static_cast<uint8_t>(page)).at(offset + 3);
-                data <<= 8;
-                data |= _pageArray.at(static_cast<uint8_t>(page)).at(offset + 2);
-                data <<= 8;
-                data |= _pageArray.at(static_cast<uint8_t>(page)).at(offset + 1);
-                data <<= 8;
-                data |= _pageArray.at(static_cast<uint8_t>(page)).at(offset + 0);
-
-                return true;
-            }
-
-            std::array<std::array<uint8_t, EMU_EEPROM_PAGE_SIZE>, 2> _pageArray;
-            size_t                                                   _pageEraseCounter = 0;
-        } _hwa;
+        HwaTest _hwa;
 
         EmuEEPROM _emuEEPROM = EmuEEPROM(_hwa, false);
     };
@@ -162,7 +107,8 @@ TEST_F(EmuEEPROMTest, PageTransfer2)
     }
 
     // now fill full page with same addresses but with different values
-    for (int i = 0; i < EMU_EEPROM_PAGE_SIZE / 4 - 1; i++)
+    // (minus two words taken by the transfer record)
+    for (int i = 0; i < EMU_EEPROM_PAGE_SIZE / 4 - 3; i++)
     {
         ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i, 1));
     }
@@ -171,7 +117,7 @@ TEST_F(EmuEEPROMTest, PageTransfer2)
     ASSERT_EQ(pageStatus_t::FORMATTED, _emuEEPROM.pageStatus(page_t::PAGE_1));
 
     // also verify that the memory contains only updated values
-    for (int i = 0; i < EMU_EEPROM_PAGE_SIZE / 4 - 1; i++)
+    for (int i = 0; i < EMU_EEPROM_PAGE_SIZE / 4 - 3; i++)
     {
         uint16_t value;
 
@@ -186,7 +132,7 @@ TEST_F(EmuEEPROMTest, PageTransfer2)
     ASSERT_EQ(pageStatus_t::FORMATTED, _emuEEPROM.pageStatus(page_t::PAGE_1));
 
     // also verify that the memory contains only updated values
-    for (int i = 0; i < EMU_EEPROM_PAGE_SIZE / 4 - 1; i++)
+    for (int i = 0; i < EMU_EEPROM_PAGE_SIZE / 4 - 3; i++)
     {
         uint16_t value;
 
@@ -217,11 +163,16 @@ TEST_F(EmuEEPROMTest, OverFlow)
     _hwa.read32(page_t::PAGE_1, 4, readData);
     ASSERT_EQ(static_cast<uint32_t>(EMU_EEPROM_PAGE_SIZE + 1) << 16 | 0x0000, readData);
 
+    // followed by a valid record
+    _hwa.write32(page_t::PAGE_1, 8, static_cast<uint32_t>(1) << 16 | 0x1234);
+
     _emuEEPROM.init();
 
-    // expect page1 to be formatted due to invalid data
+    // invalid record is skipped instead of formatting the page, so the rest of the data is kept
     _hwa.read32(page_t::PAGE_1, 4, readData);
-    ASSERT_EQ(0xFFFFFFFF, readData);
+    ASSERT_EQ(static_cast<uint32_t>(EMU_EEPROM_PAGE_SIZE + 1) << 16 | 0x0000, readData);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(1, readData16));
+    ASSERT_EQ(0x1234, readData16);
 
     // attempt to write and read an address larger than max allowed (page size / 4 minus one address)
     ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.write((EMU_EEPROM_PAGE_SIZE / 4) - 1, 0));
@@ -231,6 +182,46 @@ TEST_F(EmuEEPROMTest, OverFlow)
     ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read((EMU_EEPROM_PAGE_SIZE / 4) - 2, readData16));
 }
 
+TEST_F(EmuEEPROMTest, FullAddressSpaceTransfer)
+{
+    // page written by earlier releases with every address in use leaves no room for the transfer record
+    _hwa.erasePage(page_t::PAGE_1);
+    _hwa.erasePage(page_t::PAGE_2);
+
+    _hwa.write32(page_t::PAGE_1, 0, static_cast<uint32_t>(pageStatus_t::VALID));
+    _hwa.write32(page_t::PAGE_2, 0, static_cast<uint32_t>(pageStatus_t::FORMATTED));
+
+    for (uint32_t i = 0; i < EmuEEPROM::MAX_ADDRESS; i++)
+    {
+        ASSERT_TRUE(_hwa.write32(page_t::PAGE_1, (i + 1) * 4, i << 16 | (0x1000 + i)));
+    }
+
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    auto verify = [&]()
+    {
+        for (uint32_t i = 0; i < EmuEEPROM::MAX_ADDRESS; i++)
+        {
+            uint16_t value;
+
+            ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(i, value));
+            ASSERT_EQ(0x1000 + i, value);
+        }
+    };
+
+    verify();
+
+    // all variables are copied, transfer record is skipped
+    _emuEEPROM.pageTransfer();
+
+    ASSERT_EQ(pageStatus_t::VALID, _emuEEPROM.pageStatus(page_t::PAGE_2));
+    ASSERT_EQ(pageStatus_t::FORMATTED, _emuEEPROM.pageStatus(page_t::PAGE_1));
+    verify();
+
+    ASSERT_TRUE(_emuEEPROM.init());
+    verify();
+}
+
 TEST_F(EmuEEPROMTest, PageErase)
 {
     // at this point, emueeprom is prepared
@@ -270,4 +261,1456 @@ TEST_F(EmuEEPROMTest, CachedWrite)
 
     // after another initialization, read value should be the one that was written
     ASSERT_EQ(0x1237, value);
+}
+
+TEST_F(EmuEEPROMTest, BulkRead)
+{
+    std::array<uint16_t, 8> values = {};
+    uint32_t                present = 0;
+
+    ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.read(0, values.data(), values.size(), present));
+    ASSERT_EQ(0, present);
+
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i + 2, 0x100 + i));
+    }
+
+    // range partially covers written variables
+    ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.read(0, values.data(), values.size(), present));
+    ASSERT_EQ(values.size() - 2, present);
+    ASSERT_EQ(0xFFFF, values.at(0));
+    ASSERT_EQ(0xFFFF, values.at(1));
+    ASSERT_EQ(0x100, values.at(2));
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(2, values.data(), values.size(), present));
+    ASSERT_EQ(values.size(), present);
+
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        ASSERT_EQ(0x100 + i, values.at(i));
+
+        if constexpr (!EmuEEPROM::BOUNDED_CACHE)
+        {
+            ASSERT_EQ(0x100 + i, _emuEEPROM.cacheView().at(i + 2));
+        }
+    }
+
+    // ranges exceeding the address space are rejected
+    ASSERT_EQ(readStatus_t::READ_ERROR, _emuEEPROM.read(_emuEEPROM.maxAddress() - 1, values.data(), 2, present));
+    ASSERT_EQ(readStatus_t::READ_ERROR, _emuEEPROM.read(_emuEEPROM.maxAddress(), values.data(), 0, present));
+}
+
+TEST_F(EmuEEPROMTest, MemoryMapped)
+{
+    uint16_t value;
+
+    _hwa._mapped = true;
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    // fill the page several times over so that transfers and blank searches run over mapped memory
+    for (int i = 0; i < EMU_EEPROM_PAGE_SIZE / 2; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i % 4, 0x1000 + i));
+    }
+
+    _hwa._readCounter = 0;
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    // only page headers should have been read through read32
+    ASSERT_GT(EMU_EEPROM_PAGE_SIZE / 4, _hwa._readCounter);
+
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(i, value));
+        ASSERT_EQ(0x1000 + (EMU_EEPROM_PAGE_SIZE / 2) - 4 + i, value);
+    }
+
+    // same contents should be visible through read32 as well
+    _hwa._mapped = false;
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(i, value));
+        ASSERT_EQ(0x1000 + (EMU_EEPROM_PAGE_SIZE / 2) - 4 + i, value);
+    }
+}
+
+TEST_F(EmuEEPROMTest, MemoryMappedEndOfData)
+{
+    // counter record with its blank thermometer words, surrounded by single-word records
+    const std::array<uint32_t, 6> RECORDS = {
+        static_cast<uint32_t>(1) << 16 | 0x0011,
+        0xFFFFFF01,
+        static_cast<uint32_t>(2) << 16 | 0x0005,
+        0xFFFFFFFF,
+        0xFFFFFFFF,
+        static_cast<uint32_t>(3) << 16 | 0x0033,
+    };
+
+    uint16_t value;
+    uint32_t data;
+
+    _hwa._mapped = true;
+
+    // formatted page has no known end of data, so it's searched for on the next write
+    ASSERT_TRUE(_emuEEPROM.format());
+
+    for (size_t i = 0; i < RECORDS.size(); i++)
+    {
+        ASSERT_TRUE(_hwa.write32(page_t::PAGE_1, (i + 1) * 4, RECORDS.at(i)));
+    }
+
+    // blank words inside the counter record don't end the written data
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(4, 0x0044));
+
+    _hwa.read32(page_t::PAGE_1, (RECORDS.size() + 1) * 4, data);
+    ASSERT_EQ(static_cast<uint32_t>(4) << 16 | 0x0044, data);
+
+    ASSERT_TRUE(_emuEEPROM.init());
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(3, value));
+    ASSERT_EQ(0x0033, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(4, value));
+    ASSERT_EQ(0x0044, value);
+}
+
+TEST_F(EmuEEPROMTest, StaticHwa)
+{
+    // same flash contents accessed through statically resolved driver type
+    BasicEmuEEPROM<HwaTest> staticEmuEEPROM(_hwa, false);
+    uint16_t                value;
+
+    ASSERT_TRUE(staticEmuEEPROM.init());
+
+    for (int i = 0; i < EMU_EEPROM_PAGE_SIZE / 4; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, staticEmuEEPROM.write(i % 2, 0x1234 + i));
+    }
+
+    ASSERT_EQ(readStatus_t::OK, staticEmuEEPROM.read(1, value));
+    ASSERT_EQ(0x1234 + (EMU_EEPROM_PAGE_SIZE / 4) - 1, value);
+
+    // instance using virtual interface should see identical contents
+    ASSERT_TRUE(_emuEEPROM.init());
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0, value));
+    ASSERT_EQ(0x1234 + (EMU_EEPROM_PAGE_SIZE / 4) - 2, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(1, value));
+    ASSERT_EQ(0x1234 + (EMU_EEPROM_PAGE_SIZE / 4) - 1, value);
+}
+
+TEST_F(EmuEEPROMTest, Partitions)
+{
+    const std::array<uint32_t, 3> SIZES = { 8, 8, 4 };
+    uint16_t                      value;
+
+    // partitions larger than the address space are rejected
+    const std::array<uint32_t, 2> TOO_LARGE = { _emuEEPROM.maxAddress(), 1 };
+    ASSERT_FALSE(_emuEEPROM.definePartitions(TOO_LARGE.data(), TOO_LARGE.size()));
+
+    ASSERT_TRUE(_emuEEPROM.definePartitions(SIZES.data(), SIZES.size()));
+
+    for (uint8_t partition = 0; partition < SIZES.size(); partition++)
+    {
+        ASSERT_EQ(SIZES.at(partition), _emuEEPROM.partition(partition).size());
+
+        for (uint32_t i = 0; i < SIZES.at(partition); i++)
+        {
+            ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.partition(partition).write(i, partition << 8 | i));
+        }
+
+        // quota is enforced
+        ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.partition(partition).write(SIZES.at(partition), 0));
+        ASSERT_EQ(readStatus_t::READ_ERROR, _emuEEPROM.partition(partition).read(SIZES.at(partition), value));
+    }
+
+    // undefined partition has no space
+    ASSERT_EQ(0, _emuEEPROM.partition(SIZES.size()).size());
+    ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.partition(SIZES.size()).write(0, 0));
+
+    // partitions are laid out one after another in the address space
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(SIZES.at(0) + 1, value));
+    ASSERT_EQ(1 << 8 | 1, value);
+
+    // formatting a partition drops its variables still waiting in cache as well
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.partition(1).write(0, 0x5555, true));
+    ASSERT_TRUE(_emuEEPROM.partition(1).format());
+
+    const size_t WRITES = _hwa._writeCounter;
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.emergencyFlush());
+    ASSERT_EQ(WRITES, _hwa._writeCounter);
+    ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.partition(1).read(0, value));
+
+    for (uint32_t i = 0; i < SIZES.at(1); i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.partition(1).write(i, 1 << 8 | i));
+    }
+
+    // clearing one partition leaves others intact
+    ASSERT_TRUE(_emuEEPROM.partition(1).clear());
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    for (uint8_t partition = 0; partition < SIZES.size(); partition++)
+    {
+        for (uint32_t i = 0; i < SIZES.at(partition); i++)
+        {
+            if (partition == 1)
+            {
+                ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.partition(partition).read(i, value));
+            }
+            else
+            {
+                ASSERT_EQ(readStatus_t::OK, _emuEEPROM.partition(partition).read(i, value));
+                ASSERT_EQ(partition << 8 | i, value);
+            }
+        }
+    }
+
+    // without factory page, format is the same as clear
+    ASSERT_TRUE(_emuEEPROM.partition(2).format());
+    ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.partition(2).read(0, value));
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.partition(0).read(0, value));
+}
+
+TEST_F(EmuEEPROMTest, Image)
+{
+    static constexpr std::array<ImageVariable, 3> VARIABLES = { {
+        { 0, 0x1234 },
+        { 5, 0x0001 },
+        { 5, 0x0002 },
+    } };
+
+    constexpr auto IMAGE = BUILD_IMAGE<VARIABLES>();
+    uint16_t       value;
+
+    static_assert(IMAGE[0] == static_cast<uint32_t>(pageStatus_t::VALID));
+    static_assert(IMAGE[4] == 0xFFFFFFFF);
+
+    ASSERT_TRUE(_emuEEPROM.importImage(IMAGE.data(), IMAGE.size() * 4));
+    ASSERT_EQ(pageStatus_t::VALID, _emuEEPROM.pageStatus(page_t::PAGE_1));
+    ASSERT_EQ(pageStatus_t::FORMATTED, _emuEEPROM.pageStatus(page_t::PAGE_2));
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0, value));
+    ASSERT_EQ(0x1234, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(5, value));
+    ASSERT_EQ(0x0002, value);
+
+    // exported image is compact: header and one word per variable
+    EmuEEPROM::image_t exported;
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(7, 0x0007));
+    ASSERT_EQ(4 * 4, _emuEEPROM.exportImage(exported));
+
+    // importing it back restores the same contents
+    ASSERT_TRUE(_emuEEPROM.format());
+    ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.read(7, value));
+    ASSERT_TRUE(_emuEEPROM.importImage(exported.data(), 4 * 4));
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0, value));
+    ASSERT_EQ(0x1234, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(5, value));
+    ASSERT_EQ(0x0002, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(7, value));
+    ASSERT_EQ(0x0007, value);
+
+    // images without valid header are rejected
+    exported[0] = static_cast<uint32_t>(pageStatus_t::RECEIVING);
+    ASSERT_FALSE(_emuEEPROM.importImage(exported.data(), 4 * 4));
+
+    if constexpr (!EmuEEPROM::BOUNDED_CACHE)
+    {
+        // entire image is imported: counter record with blank words is followed by a gap and another variable
+        const std::array<uint32_t, 8> WITH_COUNTER = {
+            static_cast<uint32_t>(pageStatus_t::VALID),
+            0x00001234,
+            0xFFFFFF01,
+            0x00030005,
+            0xFFFFFFF8,
+            0xFFFFFFFF,
+            0xFFFFFFFF,
+            0x00070007,
+        };
+
+        ASSERT_TRUE(_emuEEPROM.importImage(WITH_COUNTER.data(), WITH_COUNTER.size() * 4));
+
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(3, value));
+        ASSERT_EQ(0x0008, value);
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(7, value));
+        ASSERT_EQ(0x0007, value);
+
+        // gap is left out, so writes continue right after the last variable
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.increment(3));
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(8, 0x0008));
+        ASSERT_TRUE(_emuEEPROM.init());
+
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0, value));
+        ASSERT_EQ(0x1234, value);
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(3, value));
+        ASSERT_EQ(0x0009, value);
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(7, value));
+        ASSERT_EQ(0x0007, value);
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(8, value));
+        ASSERT_EQ(0x0008, value);
+    }
+}
+
+TEST_F(EmuEEPROMTest, EmergencyFlush)
+{
+    constexpr uint32_t RESERVE = 4;
+    constexpr uint32_t USABLE  = (EMU_EEPROM_PAGE_SIZE / 4) - 1 - RESERVE;
+    uint16_t           value;
+
+    ASSERT_FALSE(_emuEEPROM.setFlushReserve((EMU_EEPROM_PAGE_SIZE / 4) - 1));
+    ASSERT_TRUE(_emuEEPROM.setFlushReserve(RESERVE));
+
+    // normal writes can't use reserved space
+    for (uint32_t i = 0; i < USABLE; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(0, i));
+    }
+
+    ASSERT_EQ(pageStatus_t::VALID, _emuEEPROM.pageStatus(page_t::PAGE_1));
+
+    for (uint32_t i = 0; i < RESERVE; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i + 1, 0x100 + i, true));
+    }
+
+    // pending values are written without any erase, one flash write per variable
+    const auto ERASE_COUNT = _hwa._pageEraseCounter;
+    const auto WRITE_COUNT = _hwa._writeCounter;
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.emergencyFlush());
+    ASSERT_EQ(ERASE_COUNT, _hwa._pageEraseCounter);
+    ASSERT_EQ(WRITE_COUNT + RESERVE, _hwa._writeCounter);
+    ASSERT_EQ(pageStatus_t::VALID, _emuEEPROM.pageStatus(page_t::PAGE_1));
+
+    // nothing left to flush
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.emergencyFlush());
+    ASSERT_EQ(WRITE_COUNT + RESERVE, _hwa._writeCounter);
+
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    for (uint32_t i = 0; i < RESERVE; i++)
+    {
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(i + 1, value));
+        ASSERT_EQ(0x100 + i, value);
+    }
+
+    // reserve is exhausted now: flush doesn't attempt page transfer
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(10, 0x10, true));
+    ASSERT_EQ(writeStatus_t::PAGE_FULL, _emuEEPROM.emergencyFlush());
+    ASSERT_EQ(ERASE_COUNT, _hwa._pageEraseCounter);
+
+    // regular write transfers the page, pending value included
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(0, 0x1234));
+    ASSERT_EQ(pageStatus_t::VALID, _emuEEPROM.pageStatus(page_t::PAGE_2));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.emergencyFlush());
+
+    ASSERT_TRUE(_emuEEPROM.init());
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(10, value));
+    ASSERT_EQ(0x10, value);
+
+    // reserve is free again after page transfer, so flushing doesn't need an erase
+    for (uint32_t i = 0; i < RESERVE; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i + 1, 0x200 + i, true));
+    }
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.emergencyFlush());
+    ASSERT_EQ(ERASE_COUNT + 1, _hwa._pageEraseCounter);
+
+    // reserve has to fit next to the variables in use: header, six variables and the transfer record
+    // (variables aren't known with bounded cache until they're copied)
+    constexpr uint32_t LARGEST = (EMU_EEPROM_PAGE_SIZE / 4) - 1 - 6 - 2 - 1;
+
+    if constexpr (!EmuEEPROM::BOUNDED_CACHE)
+    {
+        ASSERT_FALSE(_emuEEPROM.setFlushReserve(LARGEST + 1));
+    }
+
+    ASSERT_TRUE(_emuEEPROM.setFlushReserve(LARGEST));
+
+    // once new variables leave no room for it on page transfer, transfer record is left out first,
+    // and after that writes fail while the data is kept
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(11, 0x11));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(12, 0x12));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(13, 0x13));
+    ASSERT_EQ(writeStatus_t::PAGE_FULL, _emuEEPROM.write(14, 0x14));
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(13, value));
+    ASSERT_EQ(0x13, value);
+
+    ASSERT_TRUE(_emuEEPROM.setFlushReserve(0));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(14, 0x14));
+}
+
+TEST_F(EmuEEPROMTest, KeyValue)
+{
+    constexpr uint32_t KEYS = 4;
+    uint16_t           value;
+
+    // keys aren't available until slots are defined
+    ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.writeKey(0x12345678, 0));
+    ASSERT_FALSE(_emuEEPROM.defineKeys(KEYS + 1));
+    ASSERT_TRUE(_emuEEPROM.defineKeys(KEYS));
+
+    // slots are taken from the top of address space
+    ASSERT_EQ((EMU_EEPROM_PAGE_SIZE / 4) - 1 - (KEYS * 3), _emuEEPROM.maxAddress());
+
+    ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.readKey(0x12345678, value));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.writeKey(0x12345678, 0x1111));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.writeKey(0xABCD0000, 0x2222));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.writeKey("volume", 0x3333));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.writeKey("volume", 0x3334));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.writeKey(EmuEEPROM::KEY_HASH("channel"), 0x4444));
+
+    // keys which can't be told apart from unused slot are rejected
+    ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.writeKey(0xFFFF0000, 0));
+    ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.writeKey(0x0000FFFF, 0));
+
+    // all slots are used
+    ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.writeKey(0x00000001, 0));
+
+    // dense variables don't interfere with keys
+    for (uint32_t i = 0; i < EMU_EEPROM_PAGE_SIZE / 4; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i % 8, i));
+    }
+
+    // index is rebuilt from flash
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.readKey(0x12345678, value));
+    ASSERT_EQ(0x1111, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.readKey(0xABCD0000, value));
+    ASSERT_EQ(0x2222, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.readKey("volume", value));
+    ASSERT_EQ(0x3334, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.readKey("channel", value));
+    ASSERT_EQ(0x4444, value);
+    ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.readKey("missing", value));
+}
+
+TEST_F(EmuEEPROMTest, TraceReplay)
+{
+    std::array<uint8_t, 1024> buffer = {};
+    TraceRecorder             recorder(buffer.data(), buffer.size());
+    uint16_t                  value;
+
+    ASSERT_TRUE(_emuEEPROM.defineKeys(2));
+    _emuEEPROM.setTrace(&recorder);
+
+    const size_t READS     = _hwa._readCounter;
+    const size_t WRITES    = _hwa._writeCounter;
+    const size_t ERASES    = _hwa._pageEraseCounter;
+    const size_t TRANSFERS = _hwa._transferCounter;
+
+    // workload: frequent updates of few variables, cached writes, reads and keys
+    for (uint16_t i = 0; i < EMU_EEPROM_PAGE_SIZE / 2; i++)
+    {
+        _emuEEPROM.write(i % 5, i);
+        _emuEEPROM.read(i % 7, value);
+
+        if (!(i % 10))
+        {
+            _emuEEPROM.write(10, i, true);
+            _emuEEPROM.writeKey("counter", i);
+            _emuEEPROM.readKey("counter", value);
+        }
+    }
+
+    // rest of the entry points, each recorded once even if it calls others
+    std::array<uint16_t, 4> values  = {};
+    uint32_t                present = 0;
+    uint32_t                words   = 4;
+    EmuEEPROM::image_t      image;
+
+    _emuEEPROM.read(0, values.data(), values.size(), present);
+    _emuEEPROM.compact(words);
+    _emuEEPROM.pageTransfer();
+    _emuEEPROM.exportImage(image);
+
+    _emuEEPROM.writeCacheToFlash();
+    _emuEEPROM.setTrace(nullptr);
+
+    ASSERT_FALSE(recorder.overflow());
+
+    // reads of small addresses take two bytes, writes four
+    std::array<uint8_t, 2> smallBuffer = {};
+    TraceRecorder          small(smallBuffer.data(), smallBuffer.size());
+    small.record({ traceOp_t::READ, 5, 0 });
+    ASSERT_EQ(2, small.size());
+    small.record({ traceOp_t::WRITE, 5, 0 });
+    ASSERT_TRUE(small.overflow());
+    ASSERT_EQ(2, small.size());
+
+    // counts aren't limited to 16 bits
+    std::array<uint8_t, 8> rangeBuffer = {};
+    TraceRecorder          range(rangeBuffer.data(), rangeBuffer.size());
+    TraceEvent             event;
+    range.record({ traceOp_t::REMOVE, 5, 0x12345 });
+
+    TraceReader rangeReader(rangeBuffer.data(), range.size());
+    ASSERT_TRUE(rangeReader.next(event));
+    ASSERT_EQ(traceOp_t::REMOVE, event.op);
+    ASSERT_EQ(5, event.address);
+    ASSERT_EQ(0x12345, event.data);
+
+    // replay on freshly prepared flash with the same configuration
+    HwaTest   hwa;
+    EmuEEPROM emuEEPROM(hwa, false);
+
+    hwa.erasePage(page_t::PAGE_1);
+    hwa.erasePage(page_t::PAGE_2);
+    ASSERT_TRUE(emuEEPROM.init());
+    ASSERT_TRUE(emuEEPROM.defineKeys(2));
+
+    auto stats = replay(emuEEPROM, hwa, buffer.data(), recorder.size());
+
+    ASSERT_EQ((EMU_EEPROM_PAGE_SIZE / 2) * 2 + (EMU_EEPROM_PAGE_SIZE / 2 / 10 + 1) * 3 + 5, stats.calls);
+    ASSERT_EQ(_hwa._readCounter - READS, stats.reads);
+    ASSERT_EQ(_hwa._writeCounter - WRITES, stats.writes);
+    ASSERT_EQ(_hwa._pageEraseCounter - ERASES, stats.erases);
+    ASSERT_EQ(_hwa._transferCounter - TRANSFERS, stats.transfers);
+    ASSERT_LT(0, stats.transfers);
+    ASSERT_LT(0, stats.maxFlashOpsPerCall);
+
+    // both flash images end up the same
+    ASSERT_EQ(_hwa._pageArray, hwa._pageArray);
+}
+
+TEST_F(EmuEEPROMTest, SectorGeometry)
+{
+    // page 1 made of two sectors of half the minimum page size, page 2 twice as large as page 1
+    HwaSectorTest hwa(EMU_EEPROM_PAGE_SIZE / 2, 2, 4);
+    EmuEEPROM     emuEEPROM(hwa, false);
+    uint16_t      value;
+
+    ASSERT_TRUE(emuEEPROM.init());
+
+    // both pages are erased sector by sector on format
+    ASSERT_EQ(2, hwa._sectorEraseCounter.at(0));
+    ASSERT_EQ(4, hwa._sectorEraseCounter.at(1));
+    ASSERT_EQ(EmuEEPROM::MAX_ADDRESS, emuEEPROM.maxAddress());
+
+    // fill page 1 and move to page 2
+    uint16_t written = 0;
+
+    while (emuEEPROM.pageStatus(page_t::PAGE_2) != pageStatus_t::VALID)
+    {
+        ASSERT_EQ(writeStatus_t::OK, emuEEPROM.write(written % 4, written));
+        written++;
+    }
+
+    ASSERT_EQ(EMU_EEPROM_PAGE_SIZE / 4, written);
+    ASSERT_EQ(4, hwa._sectorEraseCounter.at(0));
+
+    // page 2 is used up to its real size before moving back to page 1
+    written = 0;
+
+    while (emuEEPROM.pageStatus(page_t::PAGE_1) != pageStatus_t::VALID)
+    {
+        ASSERT_EQ(writeStatus_t::OK, emuEEPROM.write(written % 4, written));
+        written++;
+    }
+
+    // page 2 already held 4 copied variables, the transfer record and the write which triggered the transfer,
+    // while the last write landed on page 1
+    ASSERT_EQ((EMU_EEPROM_PAGE_SIZE * 2 / 4) - 1 - 5 - 2 + 1, written);
+    ASSERT_EQ(8, hwa._sectorEraseCounter.at(1));
+
+    ASSERT_TRUE(emuEEPROM.init());
+
+    for (uint16_t i = 0; i < 4; i++)
+    {
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read((written - 1 - i) % 4, value));
+        ASSERT_EQ(written - 1 - i, value);
+    }
+
+    // pages smaller than EMU_EEPROM_PAGE_SIZE can't hold the entire address space
+    HwaSectorTest small(EMU_EEPROM_PAGE_SIZE / 2, 1, 2);
+    EmuEEPROM     smallEmuEEPROM(small, false);
+
+    ASSERT_FALSE(smallEmuEEPROM.init());
+}
+
+TEST_F(EmuEEPROMTest, BitRecords)
+{
+    uint16_t value;
+
+    for (int i = 0; i < 100; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.increment(5));
+    }
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(5, value));
+    ASSERT_EQ(100, value);
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.clearFlags(6, 0x0001));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.clearFlags(6, 0x0100));
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(6, value));
+    ASSERT_EQ(0xFEFE, value);
+
+    if constexpr (!EmuEEPROM::BOUNDED_CACHE)
+    {
+        // counter spans two records with bits cleared in place, so page didn't fill up
+        ASSERT_EQ(0, _hwa._transferCounter);
+    }
+
+    // records are parsed back on init and updated in place afterwards
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    const auto WRITE_COUNT = _hwa._writeCounter;
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.increment(5));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.clearFlags(6, 0x0002));
+
+    if constexpr (!EmuEEPROM::BOUNDED_CACHE)
+    {
+        ASSERT_EQ(WRITE_COUNT + 2, _hwa._writeCounter);
+    }
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(5, value));
+    ASSERT_EQ(101, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(6, value));
+    ASSERT_EQ(0xFEFC, value);
+
+    // bits can be set again only through regular write
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(6, 0x00FF));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.clearFlags(6, 0x0001));
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(6, value));
+    ASSERT_EQ(0x00FE, value);
+
+    // page transfer turns them into regular records
+    _emuEEPROM.writeCacheToFlash();
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(5, value));
+    ASSERT_EQ(101, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(6, value));
+    ASSERT_EQ(0x00FE, value);
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(7, 0xFFFE));
+    ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.increment(7));
+    ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.increment(_emuEEPROM.maxAddress()));
+}
+
+TEST_F(EmuEEPROMTest, BitRecordsFullPage)
+{
+    uint16_t value;
+
+    // with nearly every address in use, counter record no longer fits after page transfer
+    for (uint32_t i = 0; i < EmuEEPROM::MAX_ADDRESS - 1; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i, i));
+    }
+
+    // counter is then written as plain record, just like regular write would be
+    for (int i = 0; i < EMU_EEPROM_PAGE_SIZE / 4; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.increment(0));
+    }
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0, value));
+    ASSERT_EQ(EMU_EEPROM_PAGE_SIZE / 4, value);
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.clearFlags(1, 0x0001));
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(1, value));
+    ASSERT_EQ(0, value);
+
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    for (uint32_t i = 2; i < EmuEEPROM::MAX_ADDRESS - 1; i++)
+    {
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(i, value));
+        ASSERT_EQ(i, value);
+    }
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0, value));
+    ASSERT_EQ(EMU_EEPROM_PAGE_SIZE / 4, value);
+}
+
+TEST_F(EmuEEPROMTest, Remove)
+{
+    uint16_t value;
+
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i, 0x100 + i));
+    }
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.remove(1));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.removeRange(3, 2));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.removeRange(0, 0));
+    ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.remove(_emuEEPROM.maxAddress()));
+    ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.removeRange(1, _emuEEPROM.maxAddress()));
+
+    auto verify = [&]()
+    {
+        for (uint32_t i = 0; i < 6; i++)
+        {
+            if ((i == 1) || (i == 3) || (i == 4))
+            {
+                ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.read(i, value));
+            }
+            else
+            {
+                ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(i, value));
+                ASSERT_EQ(0x100 + i, value);
+            }
+        }
+    };
+
+    verify();
+
+    // tombstones are honoured after init
+    ASSERT_TRUE(_emuEEPROM.init());
+    verify();
+
+    // removed variables can be written again
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(3, 0x1234));
+    ASSERT_TRUE(_emuEEPROM.init());
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(3, value));
+    ASSERT_EQ(0x1234, value);
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.remove(3));
+
+    // both removed variables and tombstones are gone after page transfer
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.pageTransfer());
+    ASSERT_TRUE(_emuEEPROM.init());
+    verify();
+
+    uint32_t readData;
+    uint32_t words = 0;
+
+    for (uint32_t offset = 4; offset < EMU_EEPROM_PAGE_SIZE; offset += 4)
+    {
+        _hwa.read32(page_t::PAGE_2, offset, readData);
+
+        if (readData != 0xFFFFFFFF)
+        {
+            words++;
+        }
+    }
+
+    // remaining variables and the transfer record
+    ASSERT_EQ(3 + 2, words);
+}
+
+TEST_F(EmuEEPROMTest, DualBank)
+{
+    // page large enough for the erase to finish long before the next transfer
+    const uint32_t    PAGE_SIZE = EMU_EEPROM_PAGE_SIZE * 16;
+    const FlashTiming TIMING;
+    HwaTimedTest      singleHwa(PAGE_SIZE, TIMING, false);
+    HwaTimedTest      dualHwa(PAGE_SIZE, TIMING, true);
+    EmuEEPROM         single(singleHwa, false);
+    EmuEEPROM         dual(dualHwa, false);
+    uint16_t          value;
+
+    const uint32_t VARIABLES = EmuEEPROM::MAX_ADDRESS / 2;
+    const uint32_t WRITES    = (PAGE_SIZE / 4) * 3;
+
+    ASSERT_TRUE(single.init());
+    ASSERT_TRUE(dual.init());
+
+    // returns duration of the slowest write
+    auto maxWriteTime = [VARIABLES, WRITES](EmuEEPROM& emuEEPROM, HwaTimedTest& hwa)
+    {
+        uint64_t max = 0;
+
+        for (uint32_t i = 0; i < WRITES; i++)
+        {
+            const uint64_t START = hwa._time;
+            EXPECT_EQ(writeStatus_t::OK, emuEEPROM.write(i % VARIABLES, i));
+            max = std::max(max, hwa._time - START);
+        }
+
+        return max;
+    };
+
+    // page transfer doesn't wait for the old page to be erased
+    ASSERT_LE(TIMING.eraseTime, maxWriteTime(single, singleHwa));
+    ASSERT_GT(TIMING.eraseTime, maxWriteTime(dual, dualHwa));
+
+    // transfer is completed by one of the following writes
+    ASSERT_TRUE(dual.init());
+
+    for (uint32_t i = 0; i < VARIABLES; i++)
+    {
+        ASSERT_EQ(readStatus_t::OK, dual.read(i, value));
+        ASSERT_EQ(i, value % VARIABLES);
+    }
+}
+
+TEST_F(EmuEEPROMTest, Latency)
+{
+    std::vector<uint8_t> hot(8192);
+    std::vector<uint8_t> spread(8192);
+    TraceRecorder        hotRecorder(hot.data(), hot.size());
+    TraceRecorder        spreadRecorder(spread.data(), spread.size());
+    uint16_t             value;
+
+    // workloads: frequent updates of few variables, and updates spread over half of the address space
+    _emuEEPROM.setTrace(&hotRecorder);
+
+    for (uint16_t i = 0; i < 1024; i++)
+    {
+        _emuEEPROM.write(i % 4, i);
+        _emuEEPROM.read(i % 4, value);
+    }
+
+    _emuEEPROM.setTrace(&spreadRecorder);
+
+    for (uint16_t i = 0; i < 1024; i++)
+    {
+        _emuEEPROM.write((i * 7) % (_emuEEPROM.maxAddress() / 2), i);
+        _emuEEPROM.read(i % _emuEEPROM.maxAddress(), value);
+    }
+
+    _emuEEPROM.setTrace(nullptr);
+
+    ASSERT_FALSE(hotRecorder.overflow());
+    ASSERT_FALSE(spreadRecorder.overflow());
+
+    const FlashTiming TIMING;
+
+    for (const auto& [name, recorder, trace] : { std::make_tuple("hot", &hotRecorder, hot.data()),
+                                                 std::make_tuple("spread", &spreadRecorder, spread.data()) })
+    {
+        std::vector<LatencyStats> writes;
+
+        for (uint32_t pageSize : { EMU_EEPROM_PAGE_SIZE, EMU_EEPROM_PAGE_SIZE * 4, EMU_EEPROM_PAGE_SIZE * 16 })
+        {
+            HwaTimedTest hwa(pageSize, TIMING);
+            EmuEEPROM    emuEEPROM(hwa, false);
+
+            ASSERT_TRUE(emuEEPROM.init());
+
+            auto report = replayLatency(emuEEPROM, hwa, trace, recorder->size());
+            printLatency(std::string(name) + " " + std::to_string(pageSize), report);
+
+            writes.push_back(report.at(static_cast<size_t>(traceOp_t::WRITE)));
+        }
+
+        for (const auto& stats : writes)
+        {
+            // most writes take single word, while some of them end up with page transfer
+            ASSERT_EQ(1024, stats.calls);
+            ASSERT_GT(TIMING.eraseTime, stats.p50);
+            ASSERT_LE(TIMING.eraseTime, stats.max);
+        }
+
+        // transfers are too frequent to stay out of tail latency with the smallest page only
+        ASSERT_LE(TIMING.eraseTime, writes.front().p99);
+        ASSERT_GT(TIMING.eraseTime, writes.back().p99);
+    }
+}
+
+TEST_F(EmuEEPROMTest, RetainedState)
+{
+    EmuEEPROM::RetainedState state;
+    uint16_t                 value;
+
+    if constexpr (EmuEEPROM::BOUNDED_CACHE)
+    {
+        ASSERT_FALSE(_emuEEPROM.setRetainedState(&state));
+        return;
+    }
+
+    // page generation is checked on its transfer record, so page without one would be scanned
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.pageTransfer());
+
+    // state isn't valid yet, so page is scanned as usual
+    {
+        EmuEEPROM emuEEPROM(_hwa, false);
+
+        ASSERT_TRUE(emuEEPROM.setRetainedState(&state));
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(1, 0x1111));
+        ASSERT_TRUE(emuEEPROM.init());
+        ASSERT_EQ(writeStatus_t::OK, emuEEPROM.write(2, 0x2222));
+        ASSERT_EQ(writeStatus_t::OK, emuEEPROM.write(3, 0x3333, true));
+        ASSERT_EQ(writeStatus_t::OK, emuEEPROM.increment(4));
+    }
+
+    // warm reset: cache is taken over with only few words checked on flash,
+    // including the variable which was never written to flash
+    auto warmInit = [&](EmuEEPROM& emuEEPROM)
+    {
+        _hwa._readCounter = 0;
+        EXPECT_TRUE(emuEEPROM.setRetainedState(&state));
+        EXPECT_TRUE(emuEEPROM.init());
+        return _hwa._readCounter;
+    };
+
+    {
+        EmuEEPROM emuEEPROM(_hwa, false);
+
+        ASSERT_GE(6, warmInit(emuEEPROM));
+
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(1, value));
+        ASSERT_EQ(0x1111, value);
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(2, value));
+        ASSERT_EQ(0x2222, value);
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(3, value));
+        ASSERT_EQ(0x3333, value);
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(4, value));
+        ASSERT_EQ(1, value);
+
+        // state follows page transfers as well
+        for (uint16_t i = 0; i < EMU_EEPROM_PAGE_SIZE / 4; i++)
+        {
+            ASSERT_EQ(writeStatus_t::OK, emuEEPROM.write(5, i));
+        }
+
+        ASSERT_LT(0, _hwa._transferCounter);
+        ASSERT_EQ(writeStatus_t::OK, emuEEPROM.increment(4));
+    }
+
+    {
+        EmuEEPROM emuEEPROM(_hwa, false);
+
+        ASSERT_GE(6, warmInit(emuEEPROM));
+
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(3, value));
+        ASSERT_EQ(0x3333, value);
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(4, value));
+        ASSERT_EQ(2, value);
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(5, value));
+        ASSERT_EQ((EMU_EEPROM_PAGE_SIZE / 4) - 1, value);
+
+        ASSERT_EQ(writeStatus_t::OK, emuEEPROM.pageTransfer());
+        ASSERT_EQ(writeStatus_t::OK, emuEEPROM.write(5, 0x5555));
+    }
+
+    // same page transferred to twice more behind its back ends up with the same stamp, but newer generation
+    ASSERT_TRUE(_emuEEPROM.init());
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(3, 0x3030));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.pageTransfer());
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.pageTransfer());
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(5, 0x5555));
+
+    {
+        EmuEEPROM emuEEPROM(_hwa, false);
+
+        ASSERT_LT(6, warmInit(emuEEPROM));
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(3, value));
+        ASSERT_EQ(0x3030, value);
+    }
+
+    // flash written behind its back, corrupted state and interrupted update all lead to page scan
+    ASSERT_TRUE(_emuEEPROM.init());
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(1, 0x1234));
+
+    {
+        EmuEEPROM emuEEPROM(_hwa, false);
+
+        ASSERT_LT(6, warmInit(emuEEPROM));
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(1, value));
+        ASSERT_EQ(0x1234, value);
+    }
+
+    state.cache[1] = 0x4321;
+
+    {
+        EmuEEPROM emuEEPROM(_hwa, false);
+
+        ASSERT_LT(6, warmInit(emuEEPROM));
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(1, value));
+        ASSERT_EQ(0x1234, value);
+    }
+
+    state.busy = 1;
+
+    {
+        EmuEEPROM emuEEPROM(_hwa, false);
+
+        ASSERT_LT(6, warmInit(emuEEPROM));
+        ASSERT_EQ(0, state.busy);
+    }
+
+    // variable found on flash on read is taken into the state as well
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    {
+        EmuEEPROM emuEEPROM(_hwa, false);
+
+        ASSERT_GE(6, warmInit(emuEEPROM));
+
+        // flash is written behind its back and rolled back afterwards, so that only the state differs
+        const HwaTest SNAPSHOT = _hwa;
+
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(6, 0x6666));
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(6, value));
+        ASSERT_EQ(0x6666, value);
+
+        _hwa = SNAPSHOT;
+    }
+
+    {
+        EmuEEPROM emuEEPROM(_hwa, false);
+
+        ASSERT_GE(6, warmInit(emuEEPROM));
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(6, value));
+        ASSERT_EQ(0x6666, value);
+    }
+}
+
+TEST_F(EmuEEPROMTest, PowerCut)
+{
+    std::vector<uint8_t> trace(2048);
+    TraceRecorder        recorder(trace.data(), trace.size());
+
+    // workload with several page transfers and removals
+    _emuEEPROM.setTrace(&recorder);
+
+    for (uint16_t i = 0; i < 96; i++)
+    {
+        _emuEEPROM.write(i % 6, i);
+
+        if ((i % 32) == 31)
+        {
+            _emuEEPROM.removeRange(2, 2);
+        }
+    }
+
+    _emuEEPROM.setTrace(nullptr);
+    ASSERT_FALSE(recorder.overflow());
+
+    for (bool dualBank : { false, true })
+    {
+        auto results = replayPowerCuts<EmuEEPROM>(EMU_EEPROM_PAGE_SIZE, dualBank, trace.data(), recorder.size());
+        printRecovery(dualBank ? "dual bank" : "single bank", results);
+
+        ASSERT_LT(96, results.size());
+
+        for (const auto& stats : results)
+        {
+            // no data is lost, and at most the page left behind by the interrupted transfer is erased
+            ASSERT_TRUE(stats.recovered) << "cut after operation " << stats.operation;
+            ASSERT_TRUE(stats.consistent) << "cut after operation " << stats.operation;
+            ASSERT_GE(1, stats.erases) << "cut after operation " << stats.operation;
+        }
+    }
+}
+
+TEST_F(EmuEEPROMTest, IncrementalCompaction)
+{
+    uint16_t value;
+    uint32_t words;
+
+    for (uint16_t i = 0; i < 8; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i, 0x100 + i));
+    }
+
+    ASSERT_EQ(compaction_t::IDLE, _emuEEPROM.compactionState());
+
+    if constexpr (EmuEEPROM::BOUNDED_CACHE)
+    {
+        // variables are looked up on flash, so they're all copied at once:
+        // transfer doesn't start until there are enough words for the header, all of them and the transfer record
+        words = 3;
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.compact(words));
+        ASSERT_EQ(3, words);
+        ASSERT_EQ(compaction_t::IDLE, _emuEEPROM.compactionState());
+
+        words = 1 + 8 + 2;
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.compact(words));
+        ASSERT_EQ(0, words);
+        ASSERT_EQ(compaction_t::ERASING, _emuEEPROM.compactionState());
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.compact(words));
+        ASSERT_EQ(compaction_t::IDLE, _emuEEPROM.compactionState());
+        ASSERT_EQ(pageStatus_t::VALID, _emuEEPROM.pageStatus(page_t::PAGE_2));
+        return;
+    }
+
+    // page header and first two variables
+    words = 3;
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.compact(words));
+    ASSERT_EQ(0, words);
+    ASSERT_EQ(compaction_t::COPYING, _emuEEPROM.compactionState());
+    ASSERT_EQ(pageStatus_t::VALID, _emuEEPROM.pageStatus(page_t::PAGE_1));
+    ASSERT_EQ(pageStatus_t::RECEIVING, _emuEEPROM.pageStatus(page_t::PAGE_2));
+
+    // old page is still in use: already copied variable is written to both pages, the rest only to the old one
+    _hwa._writeCounter = 0;
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(1, 0x201));
+    ASSERT_EQ(2, _hwa._writeCounter);
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(5, 0x205));
+    ASSERT_EQ(3, _hwa._writeCounter);
+
+    // copying is discarded if power is lost before it's finished
+    {
+        HwaTest   hwa = _hwa;
+        EmuEEPROM emuEEPROM(hwa, false);
+
+        ASSERT_TRUE(emuEEPROM.init());
+        ASSERT_EQ(pageStatus_t::VALID, emuEEPROM.pageStatus(page_t::PAGE_1));
+        ASSERT_EQ(pageStatus_t::FORMATTED, emuEEPROM.pageStatus(page_t::PAGE_2));
+        ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(5, value));
+        ASSERT_EQ(0x205, value);
+    }
+
+    // emergency flush writes to the old page only, leaving the new one to the rest of the copying
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(0, 0x200, true));
+    _hwa._writeCounter = 0;
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.emergencyFlush());
+    ASSERT_EQ(1, _hwa._writeCounter);
+    ASSERT_EQ(compaction_t::COPYING, _emuEEPROM.compactionState());
+
+    // rest of the variables, the flushed one and the transfer record
+    words = 100;
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.compact(words));
+    ASSERT_EQ(100 - 6 - 1 - 2, words);
+    ASSERT_EQ(compaction_t::ERASING, _emuEEPROM.compactionState());
+    ASSERT_EQ(0, _hwa._pageEraseCounter);
+
+    // new page is used from now on
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(2, 0x202));
+
+    // erase and both page headers come on top of the given words, but are still accounted for
+    const auto USAGE = _emuEEPROM.flashUsage();
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.compact(words));
+    ASSERT_EQ(compaction_t::IDLE, _emuEEPROM.compactionState());
+    ASSERT_EQ(1, _hwa._pageEraseCounter);
+    ASSERT_EQ(USAGE.erased + 1, _emuEEPROM.flashUsage().erased);
+    ASSERT_EQ(USAGE.programmed + 2, _emuEEPROM.flashUsage().programmed);
+    ASSERT_EQ(pageStatus_t::FORMATTED, _emuEEPROM.pageStatus(page_t::PAGE_1));
+    ASSERT_EQ(pageStatus_t::VALID, _emuEEPROM.pageStatus(page_t::PAGE_2));
+
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    for (uint16_t i = 0; i < 8; i++)
+    {
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(i, value));
+        ASSERT_EQ((i == 0) || (i == 1) || (i == 2) || (i == 5) ? 0x200 + i : 0x100 + i, value);
+    }
+}
+
+TEST_F(EmuEEPROMTest, AbortedCompaction)
+{
+    uint16_t value;
+    uint32_t words;
+
+    for (uint16_t i = 0; i < 8; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i, 0x100 + i));
+    }
+
+    if constexpr (EmuEEPROM::BOUNDED_CACHE)
+    {
+        // variables are copied all at once, so there is nothing to abort
+        return;
+    }
+
+    // page header and first two variables
+    words = 3;
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.compact(words));
+    ASSERT_EQ(compaction_t::COPYING, _emuEEPROM.compactionState());
+
+    // new page rejects the update of already copied variable
+    ASSERT_TRUE(_hwa.write32(page_t::PAGE_2, 12, 0));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(1, 0x201));
+
+    // new page is discarded, but erasing it is left to the next step
+    ASSERT_EQ(compaction_t::ERASING, _emuEEPROM.compactionState());
+    ASSERT_EQ(0, _hwa._pageEraseCounter);
+    ASSERT_EQ(pageStatus_t::RECEIVING, _emuEEPROM.pageStatus(page_t::PAGE_2));
+
+    // old page is still in use
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(2, 0x202));
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.compact(words));
+    ASSERT_EQ(compaction_t::IDLE, _emuEEPROM.compactionState());
+    ASSERT_EQ(1, _hwa._pageEraseCounter);
+    ASSERT_EQ(pageStatus_t::VALID, _emuEEPROM.pageStatus(page_t::PAGE_1));
+    ASSERT_EQ(pageStatus_t::FORMATTED, _emuEEPROM.pageStatus(page_t::PAGE_2));
+
+    // transfer is repeated from the start
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.pageTransfer());
+    ASSERT_EQ(pageStatus_t::VALID, _emuEEPROM.pageStatus(page_t::PAGE_2));
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    for (uint16_t i = 0; i < 8; i++)
+    {
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(i, value));
+        ASSERT_EQ((i == 1) || (i == 2) ? 0x200 + i : 0x100 + i, value);
+    }
+}
+
+TEST_F(EmuEEPROMTest, CompactionScheduler)
+{
+    // a dozen instances, half of them on flash twice as slow, some with pages in separate banks
+    const uint32_t    INSTANCES = 12;
+    const uint32_t    VARIABLES = 8;
+    const uint32_t    TICKS     = 1000;
+    const uint32_t    PERIOD    = 100000;
+    const uint32_t    BUDGET    = 2500;
+    const FlashTiming FAST      = { 10, 1000, 0, 1 };
+    const FlashTiming SLOW      = { 20, 2000, 0, 1 };
+
+    struct Result
+    {
+        uint64_t maxWriteTime      = 0;    ///< Longest time spent by the writes of all instances within a tick
+        uint64_t maxCompactionTime = 0;    ///< Longest time spent by the scheduler within a tick
+        uint32_t budgetExceeded    = 0;
+        uint32_t firstCompaction   = 0;    ///< Tick in which the priority instance got compacted
+        uint32_t lastCompaction    = 0;    ///< Tick in which the last of the other instances got compacted
+    };
+
+    auto simulate = [&](bool scheduled)
+    {
+        std::vector<std::unique_ptr<HwaTimedTest>> hwa;
+        std::vector<std::unique_ptr<EmuEEPROM>>    emuEEPROM;
+        CompactionScheduler                        scheduler;
+        Result                                     result;
+
+        for (uint32_t i = 0; i < INSTANCES; i++)
+        {
+            const FlashTiming& timing = i % 2 ? SLOW : FAST;
+
+            hwa.push_back(std::make_unique<HwaTimedTest>(EMU_EEPROM_PAGE_SIZE * 4, timing, (i % 4) == 3));
+            emuEEPROM.push_back(std::make_unique<EmuEEPROM>(*hwa.back(), false));
+
+            EXPECT_TRUE(emuEEPROM.back()->init());
+
+            // first instance goes before the others
+            // erase cost includes polling the bank which is busy erasing
+            EXPECT_TRUE(scheduler.add(*emuEEPROM.back(), { timing.programTime, timing.eraseTime + 10 }, i == 0 ? 1 : 0));
+        }
+
+        EXPECT_EQ(INSTANCES, scheduler.count());
+
+        for (uint32_t tick = 0; tick < TICKS; tick++)
+        {
+            uint64_t writeTime      = 0;
+            uint64_t compactionTime = 0;
+
+            // all instances are written at the same rate and fill their pages at the same time
+            for (uint32_t i = 0; i < INSTANCES; i++)
+            {
+                hwa.at(i)->_time = std::max<uint64_t>(hwa.at(i)->_time, static_cast<uint64_t>(tick) * PERIOD);
+
+                const uint64_t START = hwa.at(i)->_time;
+                EXPECT_EQ(writeStatus_t::OK, emuEEPROM.at(i)->write(tick % VARIABLES, tick));
+                writeTime += hwa.at(i)->_time - START;
+            }
+
+            if (scheduled)
+            {
+                std::vector<uint64_t> start;
+
+                for (auto& instance : hwa)
+                {
+                    start.push_back(instance->_time);
+                }
+
+                const uint32_t SPENT = scheduler.tick(BUDGET);
+
+                for (uint32_t i = 0; i < INSTANCES; i++)
+                {
+                    compactionTime += hwa.at(i)->_time - start.at(i);
+
+                    if (hwa.at(i)->_time != start.at(i))
+                    {
+                        (i ? result.lastCompaction : result.firstCompaction) = tick;
+                    }
+                }
+
+                // cost charged by the scheduler is never lower than the actual one
+                EXPECT_GE(SPENT, compactionTime);
+                result.budgetExceeded += SPENT > BUDGET;
+            }
+
+            result.maxWriteTime      = std::max(result.maxWriteTime, writeTime);
+            result.maxCompactionTime = std::max(result.maxCompactionTime, compactionTime);
+        }
+
+        for (uint32_t i = 0; i < INSTANCES; i++)
+        {
+            EXPECT_GT(100, scheduler.fillLevel(i));
+            EXPECT_TRUE(emuEEPROM.at(i)->init());
+
+            for (uint32_t address = 0; address < VARIABLES; address++)
+            {
+                uint16_t value;
+
+                EXPECT_EQ(readStatus_t::OK, emuEEPROM.at(i)->read(address, value));
+                EXPECT_EQ(address, value % VARIABLES);
+                EXPECT_LE(TICKS - VARIABLES, value);
+            }
+        }
+
+        return result;
+    };
+
+    const auto UNSCHEDULED = simulate(false);
+    const auto SCHEDULED   = simulate(true);
+
+    // without the scheduler, erases of all the instances pile up within a single tick
+    ASSERT_LT(4 * BUDGET, UNSCHEDULED.maxWriteTime);
+
+    // with it, writes never have to transfer the page themselves, while compaction stays within the budget
+    ASSERT_GT(FAST.eraseTime, SCHEDULED.maxWriteTime);
+    ASSERT_GE(BUDGET, SCHEDULED.maxCompactionTime);
+    ASSERT_EQ(0, SCHEDULED.budgetExceeded);
+    ASSERT_LT(0, SCHEDULED.lastCompaction);
+    ASSERT_LT(SCHEDULED.firstCompaction, SCHEDULED.lastCompaction);
+
+    std::cout << "compaction scheduler: worst tick without " << UNSCHEDULED.maxWriteTime
+              << ", with " << SCHEDULED.maxWriteTime << " + " << SCHEDULED.maxCompactionTime << std::endl;
+}
+
+TEST_F(EmuEEPROMTest, CompactionSchedulerBudget)
+{
+    CompactionScheduler scheduler;
+    uint16_t            value;
+
+    const uint32_t BUDGET = 110;
+
+    ASSERT_TRUE(scheduler.add(_emuEEPROM, { 1, 100 }));
+
+    // with every address in use, there is no room for the transfer record and the old page is erased right after copying
+    for (uint32_t i = 0; i < EmuEEPROM::MAX_ADDRESS; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i, i));
+    }
+
+    for (uint32_t tick = 0; _emuEEPROM.pageStatus(page_t::PAGE_1) == pageStatus_t::VALID; tick++)
+    {
+        const auto USAGE = _emuEEPROM.flashUsage();
+
+        ASSERT_GT(10, tick);
+
+        // new page is taken over if power is lost while the old one is being erased
+        if (_emuEEPROM.compactionState() == compaction_t::ERASING)
+        {
+            HwaTest   hwa = _hwa;
+            EmuEEPROM emuEEPROM(hwa, false);
+
+            hwa.erasePage(page_t::PAGE_1);
+            ASSERT_TRUE(emuEEPROM.init());
+            ASSERT_EQ(pageStatus_t::VALID, emuEEPROM.pageStatus(page_t::PAGE_2));
+            ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(EmuEEPROM::MAX_ADDRESS - 1, value));
+            ASSERT_EQ(EmuEEPROM::MAX_ADDRESS - 1, value);
+        }
+
+        ASSERT_GE(BUDGET, scheduler.tick(BUDGET));
+        ASSERT_GE(BUDGET, (_emuEEPROM.flashUsage().programmed - USAGE.programmed) + ((_emuEEPROM.flashUsage().erased - USAGE.erased) * 100));
+    }
+
+    ASSERT_EQ(pageStatus_t::VALID, _emuEEPROM.pageStatus(page_t::PAGE_2));
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    for (uint32_t i = 0; i < EmuEEPROM::MAX_ADDRESS; i++)
+    {
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(i, value));
+        ASSERT_EQ(i, value);
+    }
+}
+
+TEST_F(EmuEEPROMTest, LayoutMigration)
+{
+    uint16_t value;
+    uint32_t readData;
+
+    // unversioned data written by older firmware
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(0, 10));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(1, 20));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(2, 30));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(3, 40));
+
+    auto doubled = [](uint16_t data) -> uint16_t
+    {
+        return data * 2;
+    };
+
+    // version 1: variables 0 and 1 swap places, 2 is converted and 3 is dropped
+    // version 2: variable 0 moves to 6
+    const EmuEEPROM::Migration MIGRATIONS[] = {
+        { 1, 0, 1, nullptr },
+        { 1, 1, 0, nullptr },
+        { 1, 2, 2, doubled },
+        { 1, 3, EmuEEPROM::Migration::REMOVED, nullptr },
+        { 2, 0, 6, nullptr },
+    };
+
+    EmuEEPROM migrated(_hwa, false);
+
+    if constexpr (EmuEEPROM::BOUNDED_CACHE)
+    {
+        ASSERT_FALSE(migrated.defineLayout(1, MIGRATIONS, 4));
+
+        // layout record left by a full cache build isn't read as variable 0
+        ASSERT_TRUE(_emuEEPROM.format());
+        ASSERT_TRUE(_hwa.write32(page_t::PAGE_1, 4, 0xFFFFFF05));
+        ASSERT_TRUE(_hwa.write32(page_t::PAGE_1, 8, 3));
+        ASSERT_TRUE(_emuEEPROM.init());
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(EMU_EEPROM_INDEX_SIZE, 0x0011));
+        ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.read(0, value));
+        return;
+    }
+
+    ASSERT_FALSE(migrated.defineLayout(0, MIGRATIONS, 5));
+    ASSERT_FALSE(migrated.defineLayout(1, MIGRATIONS, 5));
+    ASSERT_TRUE(migrated.defineLayout(1, MIGRATIONS, 4));
+
+    // migration is done in cache: only the layout record gets written
+    _hwa._writeCounter = 0;
+    ASSERT_TRUE(migrated.init());
+    ASSERT_EQ(2, _hwa._writeCounter);
+    ASSERT_EQ(0, _hwa._pageEraseCounter);
+    ASSERT_EQ(1, migrated.layoutVersion());
+
+    auto verify = [&value](EmuEEPROM& emuEEPROM, const std::array<uint16_t, 7>& expected)
+    {
+        for (uint32_t i = 0; i < expected.size(); i++)
+        {
+            if (expected[i] == 0xFFFF)
+            {
+                ASSERT_EQ(readStatus_t::NO_VAR, emuEEPROM.read(i, value));
+            }
+            else
+            {
+                ASSERT_EQ(readStatus_t::OK, emuEEPROM.read(i, value));
+                ASSERT_EQ(expected[i], value);
+            }
+        }
+    };
+
+    verify(migrated, { 20, 10, 60, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF });
+
+    // records written from now on are in the new layout and aren't migrated again
+    ASSERT_EQ(writeStatus_t::OK, migrated.write(3, 0x33));
+
+    _hwa._writeCounter = 0;
+    ASSERT_TRUE(migrated.init());
+    ASSERT_EQ(0, _hwa._writeCounter);
+    verify(migrated, { 20, 10, 60, 0x33, 0xFFFF, 0xFFFF, 0xFFFF });
+
+    // migrations of both versions are applied on records before the first layout record
+    ASSERT_TRUE(migrated.defineLayout(2, MIGRATIONS, 5));
+    ASSERT_TRUE(migrated.init());
+    ASSERT_EQ(2, migrated.layoutVersion());
+    verify(migrated, { 0xFFFF, 10, 60, 0x33, 0xFFFF, 0xFFFF, 20 });
+    ASSERT_EQ(0, _hwa._pageEraseCounter);
+
+    // variables land on flash in the new layout with the next transfer
+    ASSERT_EQ(writeStatus_t::OK, migrated.pageTransfer());
+    ASSERT_EQ(pageStatus_t::VALID, migrated.pageStatus(page_t::PAGE_2));
+
+    _hwa.read32(page_t::PAGE_2, 4, readData);
+    ASSERT_EQ(0xFFFFFF05, readData);
+    _hwa.read32(page_t::PAGE_2, 8, readData);
+    ASSERT_EQ(2, readData);
+
+    ASSERT_TRUE(migrated.init());
+    verify(migrated, { 0xFFFF, 10, 60, 0x33, 0xFFFF, 0xFFFF, 20 });
+
+    // and no longer need the migrations
+    ASSERT_TRUE(_emuEEPROM.init());
+    ASSERT_EQ(2, _emuEEPROM.layoutVersion());
+    verify(_emuEEPROM, { 0xFFFF, 10, 60, 0x33, 0xFFFF, 0xFFFF, 20 });
 }
\ No newline at end of file
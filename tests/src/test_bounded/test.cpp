@@ -0,0 +1,120 @@
+#include "tests/common.h"
+#include "tests/hwa.h"
+#include "lib/emueeprom/emueeprom.h"
+
+using namespace lib::emueeprom;
+using namespace tests;
+
+namespace
+{
+    class EmuEEPROMBoundedTest : public ::testing::Test
+    {
+        protected:
+        void SetUp()
+        {
+            _hwa.erasePage(page_t::PAGE_1);
+            _hwa.erasePage(page_t::PAGE_2);
+            ASSERT_TRUE(_emuEEPROM.init());
+            _hwa._pageEraseCounter = 0;
+        }
+
+        void TearDown()
+        {}
+
+        HwaTest _hwa;
+
+        EmuEEPROM _emuEEPROM = EmuEEPROM(_hwa, false);
+    };
+}    // namespace
+
+TEST_F(EmuEEPROMBoundedTest, Eviction)
+{
+    uint16_t value;
+
+    ASSERT_TRUE(EmuEEPROM::BOUNDED_CACHE);
+    ASSERT_EQ(0, std::tuple_size_v<EmuEEPROM::cache_t>);
+
+    // more variables than there are cache entries
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i, 0x100 + i));
+    }
+
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        for (uint32_t i = 0; i < 10; i++)
+        {
+            ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(i, value));
+            ASSERT_EQ(0x100 + i, value);
+        }
+
+        ASSERT_TRUE(_emuEEPROM.init());
+    }
+
+    ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.read(10, value));
+}
+
+TEST_F(EmuEEPROMBoundedTest, IndexedLookup)
+{
+    uint16_t value;
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i, 0x100 + i));
+    }
+
+    for (uint32_t i = 0; i < 12; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(1, i));
+    }
+
+    // address 0 shares the bucket with address 4, last written at word 5:
+    // lookup shouldn't have to go over the twelve records written after it
+    _hwa._readCounter = 0;
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0, value));
+    ASSERT_EQ(0x100, value);
+    ASSERT_GE(7, _hwa._readCounter);
+
+    // now served from cache
+    _hwa._readCounter = 0;
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0, value));
+    ASSERT_EQ(0x100, value);
+    ASSERT_EQ(0, _hwa._readCounter);
+}
+
+TEST_F(EmuEEPROMBoundedTest, DirtyEntries)
+{
+    uint16_t value;
+
+    _hwa._writeCounter = 0;
+
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(i, 0x100 + i, true));
+    }
+
+    ASSERT_EQ(0, _hwa._writeCounter);
+
+    // cache is full of entries not yet on flash, so this one goes directly to flash
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(4, 0x104, true));
+    ASSERT_EQ(1, _hwa._writeCounter);
+
+    // dirty entries aren't evicted on read misses either
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(4, value));
+    ASSERT_EQ(0x104, value);
+
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(i, value));
+        ASSERT_EQ(0x100 + i, value);
+    }
+
+    _emuEEPROM.writeCacheToFlash();
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(i, value));
+        ASSERT_EQ(0x100 + i, value);
+    }
+}
\ No newline at end of file
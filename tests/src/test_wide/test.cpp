@@ -0,0 +1,128 @@
+#include "tests/common.h"
+#include "tests/hwa.h"
+#include "lib/emueeprom/emueeprom.h"
+
+using namespace lib::emueeprom;
+using namespace tests;
+
+namespace
+{
+    class EmuEEPROMWideTest : public ::testing::Test
+    {
+        protected:
+        void SetUp()
+        {
+            _hwa.erasePage(page_t::PAGE_1);
+            _hwa.erasePage(page_t::PAGE_2);
+            ASSERT_TRUE(_emuEEPROM.init());
+            _hwa._pageEraseCounter = 0;
+        }
+
+        void TearDown()
+        {}
+
+        HwaTest _hwa;
+
+        EmuEEPROM _emuEEPROM = EmuEEPROM(_hwa, false);
+    };
+}    // namespace
+
+TEST_F(EmuEEPROMWideTest, Addresses)
+{
+    uint16_t value;
+    uint32_t readData;
+
+    ASSERT_GT(EmuEEPROM::MAX_ADDRESS, 0xFFFF);
+    ASSERT_EQ(EmuEEPROM::MAX_ADDRESS, _emuEEPROM.maxAddress());
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(5, 0x1111));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(0xFFFF, 0x2222));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(0x10000, 0x3333));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(EmuEEPROM::MAX_ADDRESS - 1, 0x4444));
+    ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.write(EmuEEPROM::MAX_ADDRESS, 0x5555));
+
+    // second record word would be blank
+    ASSERT_EQ(writeStatus_t::WRITE_ERROR, _emuEEPROM.write(0xFFFF, 0xFFFF));
+
+    // narrow address takes single word, wide ones take two
+    _hwa.read32(page_t::PAGE_1, 4, readData);
+    ASSERT_EQ(0x00051111, readData);
+    _hwa.read32(page_t::PAGE_1, 8, readData);
+    ASSERT_EQ(0xFFFF0000, readData);
+    _hwa.read32(page_t::PAGE_1, 12, readData);
+    ASSERT_EQ(0xFFFF2222, readData);
+    _hwa.read32(page_t::PAGE_1, 16, readData);
+    ASSERT_EQ(0xFFFF0001, readData);
+    _hwa.read32(page_t::PAGE_1, 20, readData);
+    ASSERT_EQ(0x00003333, readData);
+
+    // all records should be parsed back after reinit
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(5, value));
+    ASSERT_EQ(0x1111, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0xFFFF, value));
+    ASSERT_EQ(0x2222, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0x10000, value));
+    ASSERT_EQ(0x3333, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(EmuEEPROM::MAX_ADDRESS - 1, value));
+    ASSERT_EQ(0x4444, value);
+    ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.read(0x10001, value));
+
+    // 0xFFFF value isn't cached and has to be looked up on flash
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(0x10001, 0xFFFF));
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0x10001, value));
+    ASSERT_EQ(0xFFFF, value);
+}
+
+TEST_F(EmuEEPROMWideTest, PageTransfer)
+{
+    uint16_t value;
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(1, 0x1234));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(0x12345, 0x4321));
+
+    // each wide write takes two words: fill the page and trigger single transfer
+    for (uint32_t i = 0; i < (EmuEEPROM::RECORD_WORDS / 2); i++)
+    {
+        ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(0x10000, i));
+    }
+
+    ASSERT_EQ(1, _hwa._transferCounter);
+    ASSERT_EQ(pageStatus_t::VALID, _emuEEPROM.pageStatus(page_t::PAGE_2));
+
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(1, value));
+    ASSERT_EQ(0x1234, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0x12345, value));
+    ASSERT_EQ(0x4321, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0x10000, value));
+    ASSERT_EQ((EmuEEPROM::RECORD_WORDS / 2) - 1, value);
+}
+
+TEST_F(EmuEEPROMWideTest, InterruptedWrite)
+{
+    uint16_t value;
+
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(0x10000, 0x1234));
+
+    // simulate power loss after the first word of a wide record got written
+    ASSERT_TRUE(_hwa.write32(page_t::PAGE_1, 12, 0xFFFF0001));
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0x10000, value));
+    ASSERT_EQ(0x1234, value);
+    ASSERT_EQ(readStatus_t::NO_VAR, _emuEEPROM.read(0x12000, value));
+
+    // incomplete record is skipped as a whole
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(0x12000, 0x4321));
+    ASSERT_EQ(writeStatus_t::OK, _emuEEPROM.write(2, 0x5678));
+
+    ASSERT_TRUE(_emuEEPROM.init());
+
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(0x12000, value));
+    ASSERT_EQ(0x4321, value);
+    ASSERT_EQ(readStatus_t::OK, _emuEEPROM.read(2, value));
+    ASSERT_EQ(0x5678, value);
+}
\ No newline at end of file